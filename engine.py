@@ -1,7 +1,10 @@
 from board import Board
 import random
 
-def find_best_move(board):
+# Called by rollerball_py for every move, from a long-lived interpreter: module
+# state persists between moves. search.stopped() turns true once the arbiter
+# asks for the move, so a longer search should poll it and return in time.
+def find_best_move(board, search):
     print(board.get_legal_moves())
     moves = list(board.get_legal_moves())
     idx = random.randint(0, len(moves) - 1)
@@ -5,9 +5,10 @@ from setuptools import setup
 
 board_module = Pybind11Extension(
     'board',
-    ['src/board.cpp', 'src/bindings.cpp'],
+    ['src/board.cpp', 'src/batch.cpp', 'src/bindings.cpp'],
     include_dirs=['include'],
-    extra_compile_args=['-O3', '-DASIO_STANDALONE']
+    extra_compile_args=['-O3', '-DASIO_STANDALONE', '-pthread'],
+    extra_link_args=['-pthread']
 )
 
 setup(
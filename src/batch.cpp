@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "batch.hpp"
+
+bool valid_board_data(const BoardData& data) {
+
+    // read as an int, since a stray value isn't a PlayerColor to load
+    int side = 0;
+    memcpy(&side, &data.player_to_play, sizeof(data.player_to_play));
+    if (side != WHITE && side != BLACK) return false;
+
+    // piece type of each slot of a colour; pawns may have promoted
+    const U8 slot_type[6] = { ROOK, ROOK, KING, BISHOP, PAWN, PAWN };
+    const U8 *slots = (const U8*)&data;
+    U8 board_0[64] = {};
+    U64 bb_pieces[2][4] = {};
+    for (int i=0; i<12; i++) {
+        U8 p = slots[i];
+        if (p == DEAD) {
+            if (slot_type[i % 6] == KING) return false;
+            continue;
+        }
+        if (p >= 64 || getx(p) == 7 || gety(p) == 7) return false;
+        if (getx(p) >= 2 && getx(p) <= 4 && gety(p) >= 2 && gety(p) <= 4) return false;
+        if (board_0[p]) return false;
+
+        U8 color = i < 6 ? BLACK : WHITE;
+        U8 piece = data.board_0[p];
+        if ((piece & (WHITE | BLACK)) != color) return false;
+        U8 type = piece & ~(WHITE | BLACK);
+        bool promoted = slot_type[i % 6] == PAWN && (type == ROOK || type == BISHOP);
+        if (type != slot_type[i % 6] && !promoted) return false;
+
+        board_0[p] = piece;
+        bb_pieces[color_idx(color)][piece_idx(type)] |= sq_bb(p);
+    }
+
+    if (memcmp(board_0, data.board_0, sizeof(board_0)) != 0) return false;
+    for (int c=0; c<2; c++) {
+        U64 all = 0;
+        for (int t=0; t<4; t++) {
+            if (data.bb_pieces[c][t] != bb_pieces[c][t]) return false;
+            all |= bb_pieces[c][t];
+        }
+        if (data.bb_color[c] != all) return false;
+    }
+    return true;
+}
+
+// moves of positions [begin, end) appended to moves, and the number each
+// position has written to counts
+static void generate_run(const BoardData *positions, size_t begin, size_t end, std::vector<U16>& moves, uint32_t *counts) {
+
+    Board b;
+    MoveList list;
+    for (size_t i=begin; i<end; i++) {
+        b.data = positions[i];
+        list.clear();
+        b.get_legal_moves(list);
+        moves.insert(moves.end(), list.begin(), list.end());
+        counts[i] = list.size();
+    }
+}
+
+void get_legal_moves_batch(const BoardData *positions, size_t n, MoveBatch& batch, int threads) {
+
+    batch.moves.clear();
+    batch.offsets.assign(n + 1, 0);
+    uint32_t *counts = batch.offsets.data() + 1;
+
+    size_t runs = std::max<size_t>(1, std::min<size_t>(threads, n));
+    if (runs == 1) {
+        generate_run(positions, 0, n, batch.moves, counts);
+    }
+    else {
+        std::vector<std::vector<U16>> run_moves(runs);
+        std::vector<std::thread> workers;
+        for (size_t r=0; r<runs; r++) {
+            size_t begin = n * r / runs, end = n * (r + 1) / runs;
+            workers.emplace_back(generate_run, positions, begin, end, std::ref(run_moves[r]), counts);
+        }
+        for (auto& w : workers) w.join();
+
+        size_t total = 0;
+        for (auto& m : run_moves) total += m.size();
+        batch.moves.reserve(total);
+        for (auto& m : run_moves) batch.moves.insert(batch.moves.end(), m.begin(), m.end());
+    }
+
+    for (size_t i=0; i<n; i++) batch.offsets[i + 1] += batch.offsets[i];
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "board.hpp"
+
+// Legal moves of many positions in one call, for pipelines that would
+// otherwise pay a call per position. The moves of positions[i] are
+// moves[offsets[i]] up to moves[offsets[i+1]], in get_legal_moves order.
+struct MoveBatch {
+    std::vector<U16> moves;
+    std::vector<uint32_t> offsets;   // one per position, plus the end
+};
+
+// Whether data is a position the generators can be run on: every piece
+// slot on a ring square or DEAD, both kings alive, board_0 and the
+// bitboards holding exactly the pieces of the slots, and a side to move.
+// Rows that come from outside (NumPy) have to pass this first, since the
+// generators index tables with the slot bytes unchecked.
+bool valid_board_data(const BoardData& data);
+
+// threads > 1 splits the positions into that many contiguous runs, each
+// generated on its own thread
+void get_legal_moves_batch(const BoardData *positions, size_t n, MoveBatch& batch, int threads = 1);
@@ -0,0 +1,113 @@
+#include <popl.hpp>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "board.hpp"
+#include "engine.hpp"
+
+// Fixed depth searches over a few positions reached from the start
+// position. A single threaded search is deterministic, so the node total
+// only changes when the search itself does: any change to pruning,
+// reductions, ordering or evaluation has to update BENCH_NODES, and the
+// commit has to say why the new count is acceptable.
+#define BENCH_DEPTH 14
+#define BENCH_NODES 3624835ULL
+
+struct BenchPosition {
+    const char* name;
+    const char* moves;   // played from the start position
+};
+
+static const std::vector<BenchPosition> positions = {
+    {"startpos", ""},
+    {"opening", "c1b2 e6f5 c2b3 c6b6 b3a4 b6a6 a4a5 d6e6"},
+    {"check", "c1b2 e6f5 c2b3 c6b6 b3a4 b6a6 a4a5 d6e6 a5b6 c7b7 d2c2 e6d6 "
+        "c2b1 f5g4 b1a2 d7c6 d1b3 e7f6 b6c6"},
+    {"captures", "c1b1 e6f6 e1f1 f6g5 d2c1 e7f6 c2b3 c7b7 f1e1 d6e7 e2c2 "
+        "g5g4 e1f1 f6f5 b3a4 e7f7 a4b5 f7f6 d1e2 c6c7 c2d2 f5f4"},
+    {"endgame", "c1b1 e6f6 e1f1 f6g5 d2c1 e7f6 c2b3 c7b7 f1e1 d6e7 e2c2 "
+        "g5g4 e1f1 f6f5 b3a4 e7f7 a4b5 f7f6 d1e2 c6c7 c2d2 f5f4 f1f2 g4f3 "
+        "e2a4 b7a7 d2a2 f6f5 f2c2 f3g2 c1b2 g2f1 b5a6 d7c6 b2c1 c7g5 a2a1 "
+        "g5g3 c2b2 a7c7 b2b6 f5g4 c1c2 c6b5 c2b2 g4f3 b6e6"},
+};
+
+bool setup(Board& b, const std::string& moves) {
+
+    std::istringstream ss(moves);
+    std::string tok;
+    while (ss >> tok) {
+        U16 m = str_to_move(tok);
+        if (!b.get_legal_moves().contains(m)) {
+            std::cout << "ERROR: illegal move " << tok << std::endl;
+            return false;
+        }
+        b.do_move(m);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Usage: bench [options]\n"
+                          "Searches the bench positions and checks the node total");
+    int depth, movetime, threads, null_r, lmr_moves;
+    Engine e;
+    auto help_op = op.add<popl::Switch>("h", "help", "print this message");
+    op.add<popl::Value<int>>("d", "depth", "search depth", BENCH_DEPTH, &depth);
+    auto time_op = op.add<popl::Value<int>>("t", "movetime", "search each position for this many ms instead, and report the depth reached", 0, &movetime);
+    op.add<popl::Value<int>>("", "threads", "search threads", 1, &threads);
+    auto no_null_op = op.add<popl::Switch>("", "no-null", "disable null-move pruning");
+    op.add<popl::Value<int>>("", "null-r", "null-move reduction", e.null_move_r, &null_r);
+    auto no_lmr_op = op.add<popl::Switch>("", "no-lmr", "disable late move reductions");
+    op.add<popl::Value<int>>("", "lmr-full-moves", "moves searched at full depth before reducing", e.lmr_full_moves, &lmr_moves);
+    auto tb_op = op.add<popl::Value<std::string>>("", "tb", "endgame table directory, none by default", "", &e.tb_path);
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+
+    // the start position is a bench position, so it has to be searched
+    e.own_book = false;
+    e.threads = threads;
+    e.null_move = !no_null_op->is_set();
+    e.null_move_r = null_r;
+    e.lmr = !no_lmr_op->is_set();
+    e.lmr_full_moves = lmr_moves;
+    e.movetime_ms = movetime;
+    e.depth_limit = time_op->is_set() ? 0 : depth;
+
+    U64 total = 0;
+    int total_depth = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& pos : positions) {
+        Board b;
+        if (!setup(b, pos.moves)) return 1;
+
+        e.search = true;
+        e.find_best_move(b);
+        total += e.nodes_searched;
+        total_depth += e.depth_reached;
+        std::cout << "bench " << pos.name << " depth " << e.depth_reached << " nodes " << e.nodes_searched
+                  << " move " << move_to_str(e.best_move) << std::endl;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "total nodes " << total << " time " << (int)(secs * 1000) << "ms nps "
+              << (U64)(total / (secs > 0 ? secs : 1e-9)) << " average depth "
+              << (double)total_depth / positions.size() << std::endl;
+
+    // the reference only holds for the default single threaded search
+    bool reference = !time_op->is_set() && depth == BENCH_DEPTH && threads == 1
+        && e.null_move && e.lmr && null_r == Engine().null_move_r && lmr_moves == Engine().lmr_full_moves
+        && !tb_op->is_set();
+    if (reference && total != BENCH_NODES) {
+        std::cout << "FAIL expected " << BENCH_NODES << " nodes" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,12 +1,97 @@
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
+#include <cstring>
+#include <memory>
+#include <string>
 #include "board.hpp"
+#include "batch.hpp"
 
 namespace py = pybind11;
 
+// Arrays over a Board's own memory keep the Board alive through their base
+// and follow it as moves are played. They are read-only, since writing
+// board_0 or a slot would leave the bitboards and the hash behind.
+template <typename T>
+py::array_t<T> board_view(py::object self, std::vector<py::ssize_t> shape, std::vector<py::ssize_t> strides, const T *ptr) {
+    py::array_t<T> view(shape, strides, ptr, self);
+    view.attr("flags").attr("writeable") = false;
+    return view;
+}
+
+// Moves of every row of positions, each row a Board.data, as a flat uint16
+// array plus uint32 offsets. Every row is checked first, a bad one raises
+// ValueError; generation then runs without the GIL.
+py::tuple legal_moves_batch(py::array_t<U8, py::array::c_style | py::array::forcecast> positions, int threads) {
+
+    if (positions.ndim() != 2 || positions.shape(1) != (py::ssize_t)sizeof(BoardData)) {
+        throw std::invalid_argument("positions must be an (n, BOARD_DATA_SIZE) uint8 array");
+    }
+    size_t n = positions.shape(0);
+    const U8 *raw = positions.data();
+
+    std::vector<BoardData> aligned;
+    const BoardData *data = (const BoardData*)raw;
+    if ((uintptr_t)raw % alignof(BoardData)) {
+        aligned.resize(n);
+        memcpy((void*)aligned.data(), raw, n * sizeof(BoardData));
+        data = aligned.data();
+    }
+    // the generators trust the slot bytes, so a bad row must not reach them
+    for (size_t i=0; i<n; i++) {
+        if (!valid_board_data(data[i])) {
+            throw std::invalid_argument("positions row " + std::to_string(i) + " is not a valid Board.data");
+        }
+    }
+
+    std::unique_ptr<MoveBatch> batch(new MoveBatch());
+    {
+        py::gil_scoped_release release;
+        get_legal_moves_batch(data, n, *batch, threads);
+    }
+
+    // both arrays point into the batch, which lives as long as either
+    MoveBatch *b = batch.release();
+    py::capsule owner(b, [](void *p) { delete (MoveBatch*)p; });
+    return py::make_tuple(py::array_t<U16>(b->moves.size(), b->moves.data(), owner),
+                          py::array_t<uint32_t>(b->offsets.size(), b->offsets.data(), owner));
+}
+
 PYBIND11_MODULE(board, m) {
+    m.attr("DEAD") = DEAD;
+    m.attr("BOARD_DATA_SIZE") = sizeof(BoardData);
+
+    m.def("get_legal_moves_batch", &legal_moves_batch, py::arg("positions"), py::arg("threads") = 1,
+          "legal moves of each row of an (n, BOARD_DATA_SIZE) array of Board.data, as (moves, offsets) "
+          "with the moves of row i in moves[offsets[i]:offsets[i+1]]");
+
     py::class_<Board>(m, "Board")
-        .def("get_legal_moves", &Board::get_legal_moves)
+        .def(py::init<>(), "the start position")
+        .def("get_legal_moves", [](const Board& b) {
+            auto moves = b.get_legal_moves();
+            return std::unordered_set<U16>(moves.begin(), moves.end());
+        })
+        .def("get_legal_moves_array", [](const Board& b) {
+            // the array owns the MoveList the generator filled, no copy
+            MoveList *moves = new MoveList();
+            b.get_legal_moves(*moves);
+            py::capsule owner(moves, [](void *p) { delete (MoveList*)p; });
+            return py::array_t<U16>(moves->size(), moves->moves, owner);
+        }, "legal moves as a uint16 array")
+        .def_property_readonly("board_0", [](py::object self) {
+            const Board& b = self.cast<const Board&>();
+            return board_view<U8>(self, {8, 8}, {8, 1}, b.data.board_0);
+        }, "piece on each square as [y][x], a view of the board")
+        .def_property_readonly("pieces", [](py::object self) {
+            const Board& b = self.cast<const Board&>();
+            return board_view<U8>(self, {2, 6}, {6, 1}, (const U8*)&b.data);
+        }, "square of each piece slot as [black, white][slot], DEAD once captured, a view of the board")
+        .def_property_readonly("data", [](py::object self) {
+            const Board& b = self.cast<const Board&>();
+            return board_view<U8>(self, {(py::ssize_t)sizeof(BoardData)}, {1}, (const U8*)&b.data);
+        }, "the BoardData bytes, a view of the board; stack these for get_legal_moves_batch")
+        .def_property_readonly("player_to_play", [](const Board& b) { return (int)b.data.player_to_play; })
+        .def_property_readonly("hash", [](const Board& b) { return b.data.hash; })
         .def("in_check", &Board::in_check)
         .def("copy", &Board::copy)
         .def("do_move", &Board::do_move);
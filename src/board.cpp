@@ -2,6 +2,7 @@
 #include <iostream>
 #include "board.hpp"
 #include <cstring>
+#include <cassert>
 
 constexpr U8 cw_90[64] = {
     48, 40, 32, 24, 16, 8,  0,  7,
@@ -47,223 +48,391 @@ constexpr U8 id[64] = {
     56, 57, 58, 59, 60, 61, 62, 63
 };
 
-#define cw_90_pos(p) cw_90[p]
-#define cw_180_pos(p) cw_180[p]
-#define acw_90_pos(p) acw_90[p]
-#define cw_90_move(m) move_promo(cw_90[getp0(m)], cw_90[getp1(m)], getpromo(m))
-#define acw_90_move(m) move_promo(acw_90[getp0(m)], acw_90[getp1(m)], getpromo(m))
-#define cw_180_move(p) move_promo(cw_180[getp0(m)], cw_180[getp1(m)], getpromo(m))
 #define color(p) ((PlayerColor)(p & (WHITE | BLACK)))
 
-std::unordered_set<U16> transform_moves(const std::unordered_set<U16>& moves, const U8 *transform) {
+// The move rules are written for the bottom sector (squares 1-6 and 10-13).
+// Every other square is first mapped into the bottom sector with one of the
+// rotations above, and the resulting targets are mapped back. The table below
+// picks the rotation for each square: 0 = none, 1 = cw_90, 2 = cw_180, 3 = acw_90.
+constexpr U8 sector_of[64] = {
+    3, 0, 0, 0, 0, 0, 0, 0,
+    3, 3, 0, 0, 0, 0, 1, 0,
+    3, 3, 0, 0, 0, 1, 1, 0,
+    3, 3, 0, 0, 0, 1, 1, 0,
+    3, 3, 0, 0, 0, 1, 1, 0,
+    3, 2, 2, 2, 2, 1, 1, 0,
+    2, 2, 2, 2, 2, 2, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0
+};
 
-    std::unordered_set<U16> rot_moves;
+// Squares from which a pawn promotes, indexed by color_idx.
+constexpr U64 promo_squares[2] = {
+    sq_bb(pos(3,0)) | sq_bb(pos(3,1)),  // BLACK
+    sq_bb(pos(3,6)) | sq_bb(pos(3,5))   // WHITE
+};
 
-    for (U16 move : moves) {
-        rot_moves.insert(move_promo(transform[getp0(move)], transform[getp1(move)], getpromo(move)));
-    }
+// Precomputed attacks for every square. A piece's targets are the union of
+// single steps (only blocked by our own pieces) and at most two sliding
+// rays, which stop at the first occupied square. For sliders, beyond[p0][p1]
+// holds the squares that come after p1 on the ray from p0 through p1, so
+// the targets for an occupancy are found by clearing beyond[p0][b] for each
+// blocker b.
+//
+// The *_to tables run the other way: *_steps_to[p1] and *_rays_to[p1] are the
+// squares a piece could attack p1 from, and before[p0][p1] holds the squares
+// that must be empty for the ray from p0 to reach p1.
+struct AttackTables {
+    U64 pawn_steps[64];
+    U64 king_steps[64];
+    U64 rook_steps[64];
+    U64 rook_rays[64];
+    U64 rook_beyond[64][64];
+    U64 rook_before[64][64];
+    U64 bishop_steps[64];
+    U64 bishop_rays[64];
+    U64 bishop_beyond[64][64];
+    U64 bishop_before[64][64];
+
+    U64 pawn_steps_to[64];
+    U64 king_steps_to[64];
+    U64 rook_steps_to[64];
+    U64 rook_rays_to[64];
+    U64 bishop_steps_to[64];
+    U64 bishop_rays_to[64];
+
+    // set if two rays of one piece share a square, which before[][] can't express
+    bool rays_overlap;
+};
 
-    return rot_moves;
-}
+// Collects one piece's moves in bottom sector coordinates, and stores them
+// for the original square.
+struct BottomMoves {
+    U8 p0;
+    const U8 *inv_coord_map;
+    U64 steps = 0;
+    U64 rays = 0;
+    U64 beyond[64] = {};
+    U64 before[64] = {};
+    U8 ray[12] = {};
+    int ray_len = 0;
+    bool overlap = false;
+
+    constexpr void step(U8 p1) { steps |= sq_bb(inv_coord_map[p1]); }
+    constexpr void ray_push(U8 p1) { ray[ray_len++] = inv_coord_map[p1]; }
+    constexpr void ray_end() {
+        for (int i=0; i<ray_len; i++) {
+            if (rays & sq_bb(ray[i])) overlap = true;
+            rays |= sq_bb(ray[i]);
+            for (int j=0; j<i; j++)         before[ray[i]] |= sq_bb(ray[j]);
+            for (int j=i+1; j<ray_len; j++) beyond[ray[i]] |= sq_bb(ray[j]);
+        }
+        ray_len = 0;
+    }
+};
 
-std::unordered_set<U16> construct_bottom_rook_moves_with_board(const U8 p0, const U8* board) {
+constexpr void bottom_rook_moves(BottomMoves& m) {
 
-    int left_rook_reflect[7] = {0, 8, 16, 24, 32, 40, 48};
-    PlayerColor color = color(board[p0]);
-    std::unordered_set<U16> rook_moves;
-    bool refl_blocked = false;
+    const U8 p0 = m.p0;
 
     if (p0 < 8 || p0 == 13) {
-        if (!(board[p0+pos(0,1)] & color)) rook_moves.insert(move(p0, p0+pos(0,1))); // top
+        m.step(p0+pos(0,1)); // top
         if (p0 == 1) { // top continued on the edge
-            for (int y = 1; y<=6; y++) {
-                U8 p1 = pos(1, y);
-                if (board[p1]) {
-                    if (board[p1] & color) break;         // our piece
-                    else rook_moves.insert(move(p0, p1)); // their piece - capture
-                    break;
-                }
-                else rook_moves.insert(move(p0, p1));
-            }
+            for (int y = 1; y<=6; y++) m.ray_push(pos(1, y));
+            m.ray_end();
         }
     }
-    if (p0 >= 8) {
-        if (!(board[p0-pos(0,1)] & color)) rook_moves.insert(move(p0, p0-pos(0,1))); // bottom
-    }
-
-    if (p0 != 6) {
-        if (!(board[p0+pos(1,0)] & color)) rook_moves.insert(move(p0, p0+pos(1,0))); // right
-    }
+    if (p0 >= 8) m.step(p0-pos(0,1)); // bottom
+    if (p0 != 6) m.step(p0+pos(1,0)); // right
 
-    for (int x=getx(p0)-1; x>=0; x--) {
-        U8 p1 = pos(x, gety(p0));
-        if (board[p1]) {
-            refl_blocked = true;
-            if (board[p1] & color) break;         // our piece
-            else rook_moves.insert(move(p0, p1)); // their piece - capture
-            break;
-        }
-        else {
-            rook_moves.insert(move(p0, p1));
-        }
-    }
-
-    if (refl_blocked) return rook_moves;
-    
+    // left, reflecting off the corner up the left edge
+    for (int x=getx(p0)-1; x>=0; x--) m.ray_push(pos(x, gety(p0)));
     if (p0 < 8) {
-        for (int p1 : left_rook_reflect) {
-            if (board[p1]) {
-                if (board[p1] & color) break;         // our piece
-                else rook_moves.insert(move(p0, p1)); // their piece - capture
-                break;
-            }
-            else {
-                rook_moves.insert(move(p0, p1));
-            }
-        }
+        for (int y=1; y<=6; y++) m.ray_push(pos(0, y));
     }
-
-    return rook_moves;
+    m.ray_end();
 }
 
-std::unordered_set<U16> construct_bottom_bishop_moves_with_board(const U8 p0, const U8* board) {
+constexpr void bottom_bishop_moves(BottomMoves& m) {
 
-    PlayerColor color = color(board[p0]);
-    std::unordered_set<U16> bishop_moves;
+    const U8 p0 = m.p0;
 
     // top right - move back
-    if (p0 < 6 || p0 >= 12) {
-        if (!(board[p0+pos(0,1)+pos(1,0)] & color)) bishop_moves.insert(move(p0, p0+pos(0,1)+pos(1,0)));
-    }
+    if (p0 < 6 || p0 >= 12) m.step(p0+pos(0,1)+pos(1,0));
     // bottom right - move back
-    if (p0 > 6) {
-        if (!(board[p0-pos(0,1)+pos(1,0)] & color)) bishop_moves.insert(move(p0, p0-pos(0,1)+pos(1,0)));
-    }
-
-    std::vector<U8> p1s;
-    std::vector<U8> p1s_2;
+    if (p0 > 6) m.step(p0-pos(0,1)+pos(1,0));
 
     // top left - forward / reflections
     if (p0 == 1) {
-        p1s.push_back(pos(0,1));
-        p1s.push_back(pos(1,2));
+        m.ray_push(pos(0,1));
+        m.ray_push(pos(1,2));
     }
     else if (p0 == 2) {
-        p1s.push_back(pos(1,1));
-        p1s.push_back(pos(0,2));
-        p1s.push_back(pos(1,3));
+        m.ray_push(pos(1,1));
+        m.ray_push(pos(0,2));
+        m.ray_push(pos(1,3));
     }
     else if (p0 == 3) {
-        p1s.push_back(pos(2,1));
-        p1s.push_back(pos(1,2));
-        p1s.push_back(pos(0,3));
-        p1s.push_back(pos(1,4));
-        p1s.push_back(pos(2,5));
-        p1s.push_back(pos(3,6));
+        m.ray_push(pos(2,1));
+        m.ray_push(pos(1,2));
+        m.ray_push(pos(0,3));
+        m.ray_push(pos(1,4));
+        m.ray_push(pos(2,5));
+        m.ray_push(pos(3,6));
     }
     else if (p0 == 4 || p0 == 5) {
-        p1s.push_back(p0+pos(0,1)-pos(1,0));
-        p1s.push_back(p0-pos(2,0));
+        m.ray_push(p0+pos(0,1)-pos(1,0));
+        m.ray_push(p0-pos(2,0));
     }
     else if (p0 == 6) {
-        p1s.push_back(pos(5,1));
+        m.ray_push(pos(5,1));
     }
     else if (p0 == 10) {
-        p1s_2.push_back(pos(1,0));
-        p1s_2.push_back(pos(0,1));
+        m.ray_push(pos(1,0));
+        m.ray_push(pos(0,1));
+        m.ray_end();
 
-        p1s.push_back(pos(1,2));
-        p1s.push_back(pos(0,3));
-        p1s.push_back(pos(1,4));
-        p1s.push_back(pos(2,5));
-        p1s.push_back(pos(3,6));
+        m.ray_push(pos(1,2));
+        m.ray_push(pos(0,3));
+        m.ray_push(pos(1,4));
+        m.ray_push(pos(2,5));
+        m.ray_push(pos(3,6));
     }
     else if (p0 == 11) {
-        p1s.push_back(pos(2,0));
-        p1s.push_back(pos(1,1));
-        p1s.push_back(pos(0,2));
+        m.ray_push(pos(2,0));
+        m.ray_push(pos(1,1));
+        m.ray_push(pos(0,2));
     }
     else if (p0 == 12) {
-        p1s.push_back(pos(3,0));
-        p1s.push_back(pos(2,1));
-        p1s.push_back(pos(1,2));
-        p1s.push_back(pos(0,3));
+        m.ray_push(pos(3,0));
+        m.ray_push(pos(2,1));
+        m.ray_push(pos(1,2));
+        m.ray_push(pos(0,3));
     }
     else if (p0 == 13) {
-        p1s.push_back(pos(4,0));
-        p1s.push_back(pos(3,1));
+        m.ray_push(pos(4,0));
+        m.ray_push(pos(3,1));
     }
+    m.ray_end();
+}
 
-    for (auto p1 : p1s) {
-        if (board[p1]) {
-            if (board[p1] & color) break;           // our piece
-            else bishop_moves.insert(move(p0, p1)); // their piece - capture
-            break;
+constexpr void bottom_pawn_moves(BottomMoves& m) {
+
+    const U8 p0 = m.p0;
+
+    m.step(pos(getx(p0)-1,0));
+    m.step(pos(getx(p0)-1,1));
+    if (p0 == 10) m.step(17);
+}
+
+constexpr void bottom_king_moves(BottomMoves& m) {
+
+    // king can't move into check. That is left to the legality filter.
+    const U8 p0 = m.p0;
+
+    m.step(pos(getx(p0)-1,0));
+    m.step(pos(getx(p0)-1,1));
+    if (p0 == 10) m.step(pos(getx(p0)-1,2));
+    if (p0 != 6)  m.step(pos(getx(p0)+1,0));
+    if (p0 != 6)  m.step(pos(getx(p0)+1,1));
+    if (p0 >= 12) m.step(pos(getx(p0)+1,2));
+    if (p0 == 13) m.step(pos(getx(p0),2));
+    m.step(pos(getx(p0),gety(p0)^1));
+}
+
+constexpr AttackTables build_attack_tables() {
+
+    AttackTables t = {};
+    const U8 *coord_maps[4]     = { id, cw_90, cw_180, acw_90 };
+    const U8 *inv_coord_maps[4] = { id, acw_90, cw_180, cw_90 };
+
+    for (int p=0; p<64; p++) {
+        // skip the centre hole and the padding column/row
+        if (getx(p) == 7 || gety(p) == 7) continue;
+        if (getx(p) >= 2 && getx(p) <= 4 && gety(p) >= 2 && gety(p) <= 4) continue;
+
+        U8 p0 = coord_maps[sector_of[p]][p];
+        const U8 *inv = inv_coord_maps[sector_of[p]];
+
+        BottomMoves pawn{p0, inv};
+        bottom_pawn_moves(pawn);
+        t.pawn_steps[p] = pawn.steps;
+
+        BottomMoves king{p0, inv};
+        bottom_king_moves(king);
+        t.king_steps[p] = king.steps;
+
+        BottomMoves rook{p0, inv};
+        bottom_rook_moves(rook);
+        t.rook_steps[p] = rook.steps;
+        t.rook_rays[p] = rook.rays;
+        t.rays_overlap |= rook.overlap;
+        for (int q=0; q<64; q++) t.rook_beyond[p][q] = rook.beyond[q];
+        for (int q=0; q<64; q++) t.rook_before[p][q] = rook.before[q];
+
+        BottomMoves bishop{p0, inv};
+        bottom_bishop_moves(bishop);
+        t.bishop_steps[p] = bishop.steps;
+        t.bishop_rays[p] = bishop.rays;
+        t.rays_overlap |= bishop.overlap;
+        for (int q=0; q<64; q++) t.bishop_beyond[p][q] = bishop.beyond[q];
+        for (int q=0; q<64; q++) t.bishop_before[p][q] = bishop.before[q];
+    }
+
+    for (int p0=0; p0<64; p0++) {
+        for (int p1=0; p1<64; p1++) {
+            if (t.pawn_steps[p0]   & sq_bb(p1)) t.pawn_steps_to[p1]   |= sq_bb(p0);
+            if (t.king_steps[p0]   & sq_bb(p1)) t.king_steps_to[p1]   |= sq_bb(p0);
+            if (t.rook_steps[p0]   & sq_bb(p1)) t.rook_steps_to[p1]   |= sq_bb(p0);
+            if (t.rook_rays[p0]    & sq_bb(p1)) t.rook_rays_to[p1]    |= sq_bb(p0);
+            if (t.bishop_steps[p0] & sq_bb(p1)) t.bishop_steps_to[p1] |= sq_bb(p0);
+            if (t.bishop_rays[p0]  & sq_bb(p1)) t.bishop_rays_to[p1]  |= sq_bb(p0);
         }
-        else {
-            bishop_moves.insert(move(p0, p1));
+    }
+
+    return t;
+}
+
+constexpr AttackTables attack_tables = build_attack_tables();
+static_assert(!attack_tables.rays_overlap, "a square on two rays of one piece needs two before[] masks");
+
+constexpr U64 splitmix64(U64& state) {
+    U64 z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys build_zobrist_keys() {
+
+    ZobristKeys keys = {};
+    U64 state = 0x526f6c6c657262ULL;
+
+    for (int c=0; c<2; c++) {
+        for (int t=0; t<4; t++) {
+            for (int p=0; p<64; p++) {
+                keys.pieces[c][t][p] = splitmix64(state);
+            }
         }
     }
+    keys.black_to_play = splitmix64(state);
 
-    for (auto p1 : p1s_2) {
-        if (board[p1]) {
-            if (board[p1] & color) break;           // our piece
-            else bishop_moves.insert(move(p0, p1)); // their piece - capture
-            break;
+    return keys;
+}
+
+const ZobristKeys zobrist = build_zobrist_keys();
+
+// Material by piece_idx, the same weights eval_fn has always used.
+constexpr int piece_material[4] = { 100, 400, 0, 200 };
+// Bonus per pawn move saved on the way to promotion.
+#define PAWN_ADVANCE_BONUS 8
+// Bonus per square a rook or bishop attacks on an empty board.
+#define MOBILITY_BONUS 2
+
+// Pawns earn more the fewer moves they are from promoting, and rooks and
+// bishops are worth more where they reach more squares. Kings only count
+// through the search.
+constexpr PieceSquareTables build_psq_tables() {
+
+    PieceSquareTables tables = {};
+    const AttackTables& t = attack_tables;
+
+    for (int c=0; c<2; c++) {
+        // moves each square is from a square the pawn promotes from, -1 if it
+        // never gets there
+        int dist[64] = {};
+        for (int p=0; p<64; p++) dist[p] = (promo_squares[c] & sq_bb(p)) ? 0 : -1;
+        int max_dist = 0;
+        for (bool grew = true; grew; ) {
+            grew = false;
+            for (int p=0; p<64; p++) {
+                if (dist[p] >= 0) continue;
+                for (int q=0; q<64; q++) {
+                    if ((t.pawn_steps[p] & sq_bb(q)) && dist[q] == max_dist) {
+                        dist[p] = max_dist + 1;
+                        grew = true;
+                        break;
+                    }
+                }
+            }
+            if (grew) max_dist++;
         }
-        else {
-            bishop_moves.insert(move(p0, p1));
+
+        int sign = (c == color_idx(WHITE)) ? 1 : -1;
+        for (int p=0; p<64; p++) {
+            int pawn = piece_material[piece_idx(PAWN)];
+            if (dist[p] >= 0) pawn += PAWN_ADVANCE_BONUS * (max_dist - dist[p]);
+            int rook = piece_material[piece_idx(ROOK)]
+                + MOBILITY_BONUS * __builtin_popcountll(t.rook_steps[p] | t.rook_rays[p]);
+            int bishop = piece_material[piece_idx(BISHOP)]
+                + MOBILITY_BONUS * __builtin_popcountll(t.bishop_steps[p] | t.bishop_rays[p]);
+
+            tables.values[c][piece_idx(PAWN)][p]   = (int16_t)(sign * pawn);
+            tables.values[c][piece_idx(ROOK)][p]   = (int16_t)(sign * rook);
+            tables.values[c][piece_idx(KING)][p]   = (int16_t)(sign * piece_material[piece_idx(KING)]);
+            tables.values[c][piece_idx(BISHOP)][p] = (int16_t)(sign * bishop);
         }
     }
 
-    return bishop_moves;
+    return tables;
 }
 
-std::unordered_set<U16> construct_bottom_pawn_moves_with_board(const U8 p0, const U8 *board, bool promote = false) {
-    
-    PlayerColor color = color(board[p0]);
-    std::unordered_set<U16> pawn_moves;
+const PieceSquareTables psq_tables = build_psq_tables();
 
-    if (!(board[pos(getx(p0)-1,0)] & color)) {
-        if (promote) {
-            pawn_moves.insert(move_promo(p0, pos(getx(p0)-1,0), PAWN_ROOK));
-            pawn_moves.insert(move_promo(p0, pos(getx(p0)-1,0), PAWN_BISHOP));
-        }
-        else {
-            pawn_moves.insert(move(p0, pos(getx(p0)-1,0)));
-        }
+inline U64 slider_attacks(U64 rays, const U64 *beyond, U64 occ) {
+
+    U64 attacks = rays;
+    for (U64 blockers = rays & occ; blockers; blockers &= blockers-1) {
+        attacks &= ~beyond[__builtin_ctzll(blockers)];
     }
-    if (!(board[pos(getx(p0)-1,1)] & color)) {
-        if (promote) {
-            pawn_moves.insert(move_promo(p0, pos(getx(p0)-1,1), PAWN_ROOK));
-            pawn_moves.insert(move_promo(p0, pos(getx(p0)-1,1), PAWN_BISHOP));
-        }
-        else {
-            pawn_moves.insert(move(p0, pos(getx(p0)-1,1)));
-        }
+    return attacks;
+}
+
+// Whether any piece of color_idx `by` attacks p1 for the given occupancy.
+// Starts from p1 and checks only the squares an attacker could stand on, so
+// no moves are generated. Pieces on `removed` are ignored, which lets the
+// legality check drop a piece that is about to be captured.
+bool square_attacked(const BoardData& data, U8 p1, int by, U64 occ, U64 removed = 0) {
+
+    const AttackTables& t = attack_tables;
+    const U64 *pieces = data.bb_pieces[by];
+
+    if (t.pawn_steps_to[p1] & pieces[piece_idx(PAWN)] & ~removed) return true;
+    if (t.king_steps_to[p1] & pieces[piece_idx(KING)] & ~removed) return true;
+
+    U64 rooks = pieces[piece_idx(ROOK)] & ~removed;
+    if (t.rook_steps_to[p1] & rooks) return true;
+    for (U64 from = t.rook_rays_to[p1] & rooks; from; from &= from-1) {
+        if (!(t.rook_before[__builtin_ctzll(from)][p1] & occ)) return true;
     }
-    if (p0 == 10 && !(board[17] & color)) pawn_moves.insert(move(p0, 17));
 
-    return pawn_moves;
+    U64 bishops = pieces[piece_idx(BISHOP)] & ~removed;
+    if (t.bishop_steps_to[p1] & bishops) return true;
+    for (U64 from = t.bishop_rays_to[p1] & bishops; from; from &= from-1) {
+        if (!(t.bishop_before[__builtin_ctzll(from)][p1] & occ)) return true;
+    }
+
+    return false;
 }
 
-std::unordered_set<U16> construct_bottom_king_moves_with_board(const U8 p0, const U8 *board) {
+// Squares the piece on p0 attacks for the given occupancy, including the
+// squares held by its own side.
+U64 piece_attacks(U8 piece_id, U8 p0, U64 occ) {
 
-    // king can't move into check. See if these squares are under threat from 
-    // enemy pieces as well.
-    
-    PlayerColor color = color(board[p0]);
-    std::unordered_set<U16> king_moves;
-    if (!(board[pos(getx(p0)-1,0)] & color)) king_moves.insert(move(p0, pos(getx(p0)-1,0)));
-    if (!(board[pos(getx(p0)-1,1)] & color)) king_moves.insert(move(p0, pos(getx(p0)-1,1)));
-    if (p0 == 10 && !(board[pos(getx(p0)-1,2)] & color)) king_moves.insert(move(p0, pos(getx(p0)-1,2)));
-    if (p0 != 6 && !(board[pos(getx(p0)+1,0)] & color)) king_moves.insert(move(p0, pos(getx(p0)+1,0)));
-    if (p0 != 6 && !(board[pos(getx(p0)+1,1)] & color)) king_moves.insert(move(p0, pos(getx(p0)+1,1)));
-    if (p0 >= 12 && !(board[pos(getx(p0)+1,2)] & color)) king_moves.insert(move(p0, pos(getx(p0)+1,2)));
-    if (p0 == 13 && !(board[pos(getx(p0),2)] & color)) king_moves.insert(move(p0, pos(getx(p0),2)));
-    if (!(board[pos(getx(p0),gety(p0)^1)] & color)) king_moves.insert(move(p0, pos(getx(p0),gety(p0)^1)));
+    const AttackTables& t = attack_tables;
 
-    return king_moves;
+    if (piece_id & PAWN) {
+        return t.pawn_steps[p0];
+    }
+    else if (piece_id & ROOK) {
+        return t.rook_steps[p0] | slider_attacks(t.rook_rays[p0], t.rook_beyond[p0], occ);
+    }
+    else if (piece_id & BISHOP) {
+        return t.bishop_steps[p0] | slider_attacks(t.bishop_rays[p0], t.bishop_beyond[p0], occ);
+    }
+    else if (piece_id & KING) {
+        return t.king_steps[p0];
+    }
+    return 0;
 }
 
 char piece_to_char(U8 piece) {
@@ -303,12 +472,23 @@ std::string player_to_play_to_str(const Board& b) {
     }
 }
 
+void rotate_board(const U8 *src, U8 *tgt, const U8 *transform) {
+
+    for (int i=0; i<64; i++) {
+        tgt[transform[i]] = src[i];
+    }
+}
+
 std::string all_boards_to_str(const Board& b) {
 
     std::string board_str(256, ' ');
     std::string board_mask = ".......\n.......\n..   ..\n..   ..\n..   ..\n.......\n.......\n";
 
-    const U8 (*boards)[64] = &(b.data.board_0);
+    U8 boards[4][64];
+    memcpy(boards[0], b.data.board_0, 64);
+    rotate_board(b.data.board_0, boards[1], cw_90);
+    rotate_board(b.data.board_0, boards[2], cw_180);
+    rotate_board(b.data.board_0, boards[3], acw_90);
 
     for (int b=0; b<4; b++) {
         for (int i=0; i<56; i++) {
@@ -356,51 +536,123 @@ U16 str_to_move(std::string move) {
     return move_promo(pos(x0,y0), pos(x1,y1), promo);
 }
 
-std::unordered_set<U16> Board::_get_pseudolegal_moves_for_piece(U8 piece_pos) const {
-
-    std::unordered_set<U16> moves;
-    U8 piece_id = this->data.board_0[piece_pos];
-
-    std::unordered_set<U8> bottom({ 1, 2, 3, 4, 5, 6, 10, 11, 12, 13 });
-    std::unordered_set<U8> left({ 0, 8, 16, 24, 32, 40, 9, 17, 25, 33 });
-    std::unordered_set<U8> top({ 48, 49, 50, 51, 52, 53, 41, 42, 43, 44 });
-    std::unordered_set<U8> right({ 54, 46, 38, 30, 22, 14, 45, 37, 29, 21 });
+// Compact position string, FEN-like: the ranks from 7 down to 1 separated
+// by '/', each square a piece letter (KRBP, lower case for Black) or a run
+// of empty squares as a digit, then w or b for the side to move. The hole
+// in the middle counts as empty squares.
+std::string position_to_str(const Board& b) {
+
+    std::string s;
+    for (int y=6; y>=0; y--) {
+        int empty = 0;
+        for (int x=0; x<7; x++) {
+            U8 piece = b.data.board_0[pos(x,y)];
+            if (!piece) {
+                empty++;
+                continue;
+            }
+            if (empty) s += (char)('0' + empty);
+            empty = 0;
+            s += piece_to_char(piece);
+        }
+        if (empty) s += (char)('0' + empty);
+        if (y) s += '/';
+    }
 
-    const U8 *board = this->data.board_0;
-    const U8 *coord_map = id;
-    const U8 *inv_coord_map = id;
-    if      (left.count(piece_pos))  { board = this->data.board_270;  coord_map = acw_90; inv_coord_map = cw_90;  }
-    else if (top.count(piece_pos))   { board = this->data.board_180; coord_map = cw_180; inv_coord_map = cw_180; }
-    else if (right.count(piece_pos)) { board = this->data.board_90; coord_map = cw_90;  inv_coord_map = acw_90; }
+    s += b.data.player_to_play == WHITE ? " w" : " b";
+    return s;
+}
 
-    if (piece_id & PAWN) {
-        if (((piece_pos == 51 || piece_pos == 43) && (piece_id & WHITE)) || 
-            ((piece_pos == 11 || piece_pos == 3)  && (piece_id & BLACK)) ) {
-            moves = construct_bottom_pawn_moves_with_board(coord_map[piece_pos], board, true);
+bool str_to_position(const std::string& s, Board& b) {
+
+    size_t space = s.find(' ');
+    if (space == std::string::npos) return false;
+    std::string side = s.substr(space + 1);
+    if (side != "w" && side != "b") return false;
+
+    BoardData d;
+    U8 *slots = (U8*)&d;
+    for (int i=0; i<12; i++) slots[i] = DEAD;
+    memset(d.board_0, 0, sizeof(d.board_0));
+    memset(d.bb_pieces, 0, sizeof(d.bb_pieces));
+    memset(d.bb_color, 0, sizeof(d.bb_color));
+    d.hash = 0;
+    d.psqt = 0;
+
+    // piece type of each slot of a colour in the start position
+    const U8 slot_type[6] = { ROOK, ROOK, KING, BISHOP, PAWN, PAWN };
+
+    int x = 0, y = 6;
+    for (size_t i=0; i<space; i++) {
+        char ch = s[i];
+        if (ch == '/') {
+            if (x != 7 || y == 0) return false;
+            x = 0;
+            y--;
+            continue;
         }
-        else {
-            moves = construct_bottom_pawn_moves_with_board(coord_map[piece_pos], board);
+        if (ch >= '1' && ch <= '7') {
+            x += ch - '0';
+            if (x > 7) return false;
+            continue;
         }
+        if (x >= 7) return false;
+
+        U8 color = (ch >= 'A' && ch <= 'Z') ? WHITE : BLACK;
+        char lower = (color == WHITE) ? ch - ('A'-'a') : ch;
+        U8 type = lower == 'k' ? KING : lower == 'r' ? ROOK : lower == 'b' ? BISHOP : lower == 'p' ? PAWN : 0;
+        if (!type) return false;
+
+        U8 p = pos(x, y);
+        if (x >= 2 && x <= 4 && y >= 2 && y <= 4) return false;
+
+        // a piece takes a free slot of its own type, or else any free
+        // non-king one, which is where a promoted pawn would be
+        U8 *own = slots + (color == WHITE ? 6 : 0);
+        int slot = -1;
+        for (int k=0; k<6 && slot < 0; k++) {
+            if (own[k] == DEAD && slot_type[k] == type) slot = k;
+        }
+        for (int k=0; k<6 && slot < 0 && type != KING; k++) {
+            if (own[k] == DEAD && slot_type[k] != KING) slot = k;
+        }
+        if (slot < 0) return false;
+
+        own[slot] = p;
+        d.board_0[p] = color | type;
+        toggle_piece(d, color | type, p);
+        x++;
     }
-    else if (piece_id & ROOK) {
-        moves = construct_bottom_rook_moves_with_board(coord_map[piece_pos], board);
-    }
-    else if (piece_id & BISHOP) {
-        moves = construct_bottom_bishop_moves_with_board(coord_map[piece_pos], board);
-    }
-    else if (piece_id & KING) {
-        moves = construct_bottom_king_moves_with_board(coord_map[piece_pos], board);
-    }
+    if (x != 7 || y != 0) return false;
+    if (d.b_king == DEAD || d.w_king == DEAD) return false;
 
-    moves = transform_moves(moves, inv_coord_map);
+    d.player_to_play = side == "w" ? WHITE : BLACK;
+    if (d.player_to_play == BLACK) d.hash ^= zobrist.black_to_play;
 
-    return moves;
+    b.data = d;
+    b.undo_top = 0;
+    return true;
 }
 
-void rotate_board(U8 *src, U8 *tgt, const U8 *transform) {
+void Board::_get_pseudolegal_moves_for_piece(U8 piece_pos, MoveList& moves, GenMode mode) const {
 
-    for (int i=0; i<64; i++) {
-        tgt[transform[i]] = src[i];
+    U8 piece_id = this->data.board_0[piece_pos];
+    U8 c = color_idx(piece_id);
+
+    U64 occ = this->data.bb_color[0] | this->data.bb_color[1];
+    U64 targets = piece_attacks(piece_id, piece_pos, occ) & ~this->data.bb_color[c];
+    bool promote = (piece_id & PAWN) && (promo_squares[c] & sq_bb(piece_pos));
+    if (mode == GEN_CAPTURES && !promote) targets &= this->data.bb_color[c ^ 1];
+
+    for (; targets; targets &= targets-1) {
+        U8 p1 = __builtin_ctzll(targets);
+        if (promote) {
+            moves.push(move_promo(piece_pos, p1, PAWN_ROOK));
+            moves.push(move_promo(piece_pos, p1, PAWN_BISHOP));
+        }
+        else {
+            moves.push(move(piece_pos, p1));
+        }
     }
 }
 
@@ -420,29 +672,59 @@ Board::Board(): data{} {
     this->data.board_0[this->data.w_pawn_ws]  = WHITE | PAWN;
     this->data.board_0[this->data.w_pawn_bs]  = WHITE | PAWN;
 
-    rotate_board(this->data.board_0, this->data.board_90, cw_90);
-    rotate_board(this->data.board_0, this->data.board_180, cw_180);
-    rotate_board(this->data.board_0, this->data.board_270, acw_90);
+    U8 *pieces = (U8*)(&(this->data));
+    for (int i=0; i<12; i++) {
+        toggle_piece(this->data, this->data.board_0[pieces[i]], pieces[i]);
+    }
 }
 
 
-// Optimization: generate inverse king moves
-// For now, just generate moves of the opposite color and check if any of them
-// attack the king square
 bool Board::_under_threat(U8 piece_pos) const {
 
-    auto pseudolegal_moves = this->_get_pseudolegal_moves_for_side(this->data.player_to_play ^ (WHITE | BLACK));
+    U8 them = color_idx(this->data.player_to_play ^ (WHITE | BLACK));
+    U64 occ = this->data.bb_color[0] | this->data.bb_color[1];
 
-    for (auto move : pseudolegal_moves) {
-        // std::cout << move_to_str(move) << " ";
-        if (getp1(move) == piece_pos) {
-            // std::cout << "<- causes check\n";
-            return true;
-        }
+    return square_attacked(this->data, piece_pos, them, occ);
+}
+
+// Whether the side to move's king is safe after move, worked out on the
+// bitboards without making the move.
+bool Board::_is_legal(U16 move) const {
+
+    U8 p0 = getp0(move);
+    U8 p1 = getp1(move);
+    U8 us = color_idx(this->data.player_to_play);
+
+    U64 occ = ((this->data.bb_color[0] | this->data.bb_color[1]) & ~sq_bb(p0)) | sq_bb(p1);
+    U8 king_pos = (us == color_idx(WHITE)) ? this->data.w_king : this->data.b_king;
+    if (this->data.board_0[p0] & KING) king_pos = p1;
+
+    return !square_attacked(this->data, king_pos, us ^ 1, occ, sq_bb(p1));
+}
+
+// From-scratch hash, to check the incrementally updated data.hash against.
+U64 Board::compute_hash() const {
+
+    U64 hash = 0;
+    for (int p=0; p<64; p++) {
+        U8 piece = this->data.board_0[p];
+        if (piece) hash ^= zobrist.pieces[color_idx(piece)][piece_idx(piece)][p];
     }
-    // std::cout << std::endl;
+    if (this->data.player_to_play == BLACK) hash ^= zobrist.black_to_play;
 
-    return false;
+    return hash;
+}
+
+// From-scratch psqt, to check the incrementally updated data.psqt against.
+int Board::compute_psqt() const {
+
+    int psqt = 0;
+    for (int p=0; p<64; p++) {
+        U8 piece = this->data.board_0[p];
+        if (piece) psqt += psq_tables.values[color_idx(piece)][piece_idx(piece)][p];
+    }
+
+    return psqt;
 }
 
 bool Board::in_check() const {
@@ -456,15 +738,13 @@ bool Board::in_check() const {
     return _under_threat(king_pos);
 }
 
-std::unordered_set<U16> Board::_get_pseudolegal_moves() const {
-    return _get_pseudolegal_moves_for_side(this->data.player_to_play);
+void Board::_get_pseudolegal_moves(MoveList& moves, GenMode mode) const {
+    _get_pseudolegal_moves_for_side(this->data.player_to_play, moves, mode);
 }
 
-std::unordered_set<U16> Board::_get_pseudolegal_moves_for_side(U8 color) const {
+void Board::_get_pseudolegal_moves_for_side(U8 color, MoveList& moves, GenMode mode) const {
 
     // std::cout << "Getting Pseudolegal moves for " << (char)((color>>5) + 'a') << "\n";
-    std::unordered_set<U16> pseudolegal_moves;
-
     U8 *pieces = (U8*)(&(this->data));
 
     if (color == WHITE) {
@@ -475,12 +755,8 @@ std::unordered_set<U16> Board::_get_pseudolegal_moves_for_side(U8 color) const {
         //std::cout << "checking " << piece_to_char(this->data.board_0[pieces[i]]) << "\n";
         if (pieces[i] == DEAD) continue;
         //std::cout << "Getting Moves for " << piece_to_char(this->data.board_0[pieces[i]]) << "\n";
-        auto piece_moves = this->_get_pseudolegal_moves_for_piece(pieces[i]);
-        pseudolegal_moves.insert(piece_moves.begin(), piece_moves.end());
+        this->_get_pseudolegal_moves_for_piece(pieces[i], moves, mode);
     }
-
-    return pseudolegal_moves;
-
 }
 
 Board* Board::copy() const {
@@ -492,70 +768,114 @@ Board* Board::copy() const {
 }
 
 // legal move generation:
-// if the king is under check: (Possible optimization, as this should be faster)
-//     Look for moves that protect the king from check
-// else:
 //     Get all pseudolegal moves
-//     for each pseudolegal move for our color:
-//         if doing this move will leave the king in threat from opponent's pieces
-//             don't add the move to legal moves
-//         else
-//             add to legal moves
-//
-// Only implement the else case for now
-std::unordered_set<U16> Board::get_legal_moves() const {
+//     keep the ones that don't leave our king attacked
+void Board::get_legal_moves(MoveList& legal_moves, GenMode mode) const {
 
-    Board* c = this->copy();
-    auto pseudolegal_moves = c->_get_pseudolegal_moves();
-    std::unordered_set<U16> legal_moves;
+    MoveList pseudolegal_moves;
+    _get_pseudolegal_moves(pseudolegal_moves, mode);
+    legal_moves.clear();
 
     for (auto move : pseudolegal_moves) {
-        c->_do_move(move);
-
-        if (!c->in_check()) {
-            legal_moves.insert(move);
+        if (_is_legal(move)) {
+            legal_moves.push(move);
         }
-
-        c->_undo_last_move(move);
     }
+}
 
-    delete c;
+MoveList Board::get_legal_moves() const {
 
+    MoveList legal_moves;
+    get_legal_moves(legal_moves);
     return legal_moves;
 }
 
+void Board::get_retractions(MoveList& moves) const {
+
+    const AttackTables& t = attack_tables;
+    U8 c = color_idx(this->data.player_to_play ^ (WHITE | BLACK));
+    U64 occ = this->data.bb_color[0] | this->data.bb_color[1];
+
+    for (U64 ours = this->data.bb_color[c]; ours; ours &= ours-1) {
+        U8 p1 = __builtin_ctzll(ours);
+        U8 piece_id = this->data.board_0[p1];
+
+        U64 from;
+        if (piece_id & PAWN)      from = t.pawn_steps_to[p1] & ~promo_squares[c];
+        else if (piece_id & KING) from = t.king_steps_to[p1];
+        else if (piece_id & ROOK) from = t.rook_steps_to[p1] | t.rook_rays_to[p1];
+        else                      from = t.bishop_steps_to[p1] | t.bishop_rays_to[p1];
+
+        // a slider only got here if the squares in between were empty
+        for (from &= ~occ; from; from &= from-1) {
+            U8 p0 = __builtin_ctzll(from);
+            U64 occ_before = (occ & ~sq_bb(p1)) | sq_bb(p0);
+            if (piece_attacks(piece_id, p0, occ_before) & sq_bb(p1)) {
+                moves.push(move(p0, p1));
+            }
+        }
+    }
+}
+
 void Board::do_move(U16 move) {
-    _do_move(move);
+    UndoInfo undo;
+    _do_move(move, undo);
+    _flip_player();
+}
+
+void Board::make_move(U16 move) {
+    assert(this->undo_top < MAX_UNDO);
+    _do_move(move, this->undo_stack[this->undo_top++]);
+    _flip_player();
+}
+
+void Board::unmake_move() {
+    assert(this->undo_top > 0);
+    _flip_player();
+    _undo_last_move(this->undo_stack[--this->undo_top]);
+}
+
+void Board::make_null_move() {
+    _flip_player();
+}
+
+void Board::unmake_null_move() {
     _flip_player();
 }
 
 void Board::_flip_player() {
     this->data.player_to_play = (PlayerColor)(this->data.player_to_play ^ (WHITE | BLACK));
+    this->data.hash ^= zobrist.black_to_play;
 }
 
-void Board::_do_move(U16 move) {
+void Board::_do_move(U16 move, UndoInfo& undo) {
 
     U8 p0 = getp0(move);
     U8 p1 = getp1(move);
     U8 promo = getpromo(move);
 
     U8 piecetype = this->data.board_0[p0];
-    this->data.last_killed_piece = 0;
-    this->data.last_killed_piece_idx = -1;
+    U8 deadpiece = this->data.board_0[p1];
+    undo.move = move;
+    undo.captured = deadpiece;
+    undo.captured_idx = -1;
+    undo.hash = this->data.hash;
 
     // scan and get piece from coord
-    U8 *pieces = (U8*)this;
+    U8 *pieces = (U8*)(&(this->data));
     for (int i=0; i<12; i++) {
         if (pieces[i] == p1) {
             pieces[i] = DEAD;
-            this->data.last_killed_piece = this->data.board_0[p1];
-            this->data.last_killed_piece_idx = i;
+            undo.captured_idx = i;
         }
         if (pieces[i] == p0) {
             pieces[i] = p1;
         }
     }
 
+    if (deadpiece) toggle_piece(this->data, deadpiece, p1);
+    toggle_piece(this->data, piecetype, p0);
+
     if (promo == PAWN_ROOK) {
         piecetype = (piecetype & (WHITE | BLACK)) | ROOK;
     }
@@ -563,29 +883,27 @@ void Board::_do_move(U16 move) {
         piecetype = (piecetype & (WHITE | BLACK)) | BISHOP;
     }
 
-    this->data.board_0[p1]           = piecetype;
-    this->data.board_90[cw_90[p1]]   = piecetype;
-    this->data.board_180[cw_180[p1]] = piecetype;
-    this->data.board_270[acw_90[p1]] = piecetype;
+    toggle_piece(this->data, piecetype, p1);
+    this->data.board_0[p1] = piecetype;
+    this->data.board_0[p0] = 0;
 
-    this->data.board_0[p0]           = 0;
-    this->data.board_90[cw_90[p0]]   = 0;
-    this->data.board_180[cw_180[p0]] = 0;
-    this->data.board_270[acw_90[p0]] = 0;
+#ifdef BOARD_DEBUG
+    assert(this->data.hash == compute_hash());
+    assert(this->data.psqt == compute_psqt());
+#endif
 
     // std::cout << "Did last move\n";
     // std::cout << all_boards_to_str(*this);
 }
 
-void Board::_undo_last_move(U16 move) {
+void Board::_undo_last_move(const UndoInfo& undo) {
 
-    U8 p0 = getp0(move);
-    U8 p1 = getp1(move);
-    U8 promo = getpromo(move);
+    U8 p0 = getp0(undo.move);
+    U8 p1 = getp1(undo.move);
+    U8 promo = getpromo(undo.move);
 
     U8 piecetype = this->data.board_0[p1];
-    U8 deadpiece = this->data.last_killed_piece;
-    this->data.last_killed_piece = 0;
+    U8 deadpiece = undo.captured;
 
     // scan and get piece from coord
     U8 *pieces = (U8*)(&(this->data));
@@ -595,27 +913,26 @@ void Board::_undo_last_move(U16 move) {
             break;
         }
     }
-    if (this->data.last_killed_piece_idx >= 0) {
-        pieces[this->data.last_killed_piece_idx] = p1;
-        this->data.last_killed_piece_idx = -1;
+    if (undo.captured_idx >= 0) {
+        pieces[undo.captured_idx] = p1;
     }
 
-    if (promo == PAWN_ROOK) {
-        piecetype = ((piecetype & (WHITE | BLACK)) ^ ROOK) | PAWN;
-    }
-    else if (promo == PAWN_BISHOP) {
-        piecetype = ((piecetype & (WHITE | BLACK)) ^ BISHOP) | PAWN;
+    toggle_piece(this->data, piecetype, p1);
+
+    if (promo) {
+        piecetype = (piecetype & (WHITE | BLACK)) | PAWN;
     }
 
-    this->data.board_0[p0]           = piecetype;
-    this->data.board_90[cw_90[p0]]   = piecetype;
-    this->data.board_180[cw_180[p0]] = piecetype;
-    this->data.board_270[acw_90[p0]] = piecetype;
+    toggle_piece(this->data, piecetype, p0);
+    if (deadpiece) toggle_piece(this->data, deadpiece, p1);
+    this->data.board_0[p0] = piecetype;
+    this->data.board_0[p1] = deadpiece;
 
-    this->data.board_0[p1]           = deadpiece;
-    this->data.board_90[cw_90[p1]]   = deadpiece;
-    this->data.board_180[cw_180[p1]] = deadpiece;
-    this->data.board_270[acw_90[p1]] = deadpiece;
+#ifdef BOARD_DEBUG
+    assert(this->data.hash == undo.hash);
+    assert(this->data.hash == compute_hash());
+    assert(this->data.psqt == compute_psqt());
+#endif
 
     // std::cout << "Undid last move\n";
     // std::cout << all_boards_to_str(*this);
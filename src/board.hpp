@@ -1,11 +1,14 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <unordered_set>
 #include <stack>
 
 typedef uint8_t U8;
 typedef uint16_t U16;
+typedef uint64_t U64;
 
 #define pos(x,y) (((y)<<3)|(x))
 #define gety(p)  ((p)>>3)
@@ -19,6 +22,10 @@ typedef uint16_t U16;
 
 #define DEAD pos(7,7)
 
+#define sq_bb(p)      (1ULL<<(p))
+#define color_idx(c)  (((c)>>6)&1)                  // BLACK -> 0, WHITE -> 1
+#define piece_idx(pc) (__builtin_ctz((pc)&0x1e)-1)  // PAWN, ROOK, KING, BISHOP -> 0..3
+
 enum PlayerColor {
     WHITE=(1<<6),
     BLACK=(1<<5)
@@ -56,39 +63,145 @@ struct BoardData {
     U8 w_pawn_bs  = pos(2,0);
     
     U8 board_0[64];
-    U8 board_90[64];
-    U8 board_180[64];
-    U8 board_270[64];
+
+    // one occupancy mask per [color_idx][piece_idx], plus the union per color.
+    // Kept in sync with board_0 through toggle_piece.
+    U64 bb_pieces[2][4];
+    U64 bb_color[2];
 
     PlayerColor player_to_play = WHITE;
-    U8 last_killed_piece = 0;
-    int last_killed_piece_idx = -1;
 
+    // Zobrist key of the position, including the side to move
+    U64 hash;
+
+    // material plus piece-square bonuses in centipawns, White minus Black.
+    // Kept in sync with board_0 through toggle_piece.
+    int psqt;
+
+};
+
+// A side has a king (at most 7 moves), a bishop (8), two rooks (14 each)
+// and two pawns (4 each, both promotions of two squares). A pawn gains the
+// most by promoting to a rook, so the worst case is king, bishop and four
+// rooks: 7 + 8 + 4*14 = 71 moves, which MAX_MOVES leaves room for.
+#define MAX_MOVES 128
+
+// Fixed-capacity move buffer that the generators fill in place. Moves come
+// out in piece-slot order, so iteration order is deterministic.
+struct MoveList {
+
+    U16 moves[MAX_MOVES];
+    int count = 0;
+
+    void push(U16 move) { moves[count++] = move; }
+    void clear() { count = 0; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool contains(U16 move) const {
+        for (int i=0; i<count; i++) if (moves[i] == move) return true;
+        return false;
+    }
+
+    U16& operator[](int i) { return moves[i]; }
+    U16 operator[](int i) const { return moves[i]; }
+    U16* begin() { return moves; }
+    U16* end() { return moves + count; }
+    const U16* begin() const { return moves; }
+    const U16* end() const { return moves + count; }
+};
+
+// What the move generator produces. GEN_CAPTURES is captures and
+// promotions only, for the quiescence search.
+enum GenMode {
+    GEN_ALL,
+    GEN_CAPTURES,
+};
+
+// Most make_move calls that can be outstanding at once: up to 256 plies can
+// be taken back, and make_move asserts beyond that. do_move doesn't count.
+#define MAX_UNDO 256
+
+// Everything make_move overwrites that the move itself doesn't tell us.
+struct UndoInfo {
+    U16 move;
+    U8 captured;         // piece that stood on p1, 0 if the move wasn't a capture
+    int8_t captured_idx; // its piece slot, -1 if none
+    U64 hash;            // hash before the move
 };
 
+struct ZobristKeys {
+    U64 pieces[2][4][64]; // [color_idx][piece_idx][square]
+    U64 black_to_play;
+};
+
+extern const ZobristKeys zobrist;
+
+// What a piece is worth on a square, in centipawns from White's point of
+// view (so Black's values are negative).
+struct PieceSquareTables {
+    int16_t values[2][4][64]; // [color_idx][piece_idx][square]
+};
+
+extern const PieceSquareTables psq_tables;
+
+// adds the piece to sq if it isn't there, removes it otherwise.
+inline void toggle_piece(BoardData& data, U8 piece, U8 sq) {
+    U64& bb = data.bb_pieces[color_idx(piece)][piece_idx(piece)];
+    bb ^= sq_bb(sq);
+    data.bb_color[color_idx(piece)] ^= sq_bb(sq);
+    data.hash ^= zobrist.pieces[color_idx(piece)][piece_idx(piece)][sq];
+
+    int value = psq_tables.values[color_idx(piece)][piece_idx(piece)][sq];
+    data.psqt += (bb & sq_bb(sq)) ? value : -value;
+}
+
 struct Board {
 
     BoardData data;
+    UndoInfo undo_stack[MAX_UNDO];
+    int undo_top = 0;
 
     Board();
 
-    std::unordered_set<U16> get_legal_moves() const;
+    MoveList get_legal_moves() const;
+    void get_legal_moves(MoveList& moves, GenMode mode = GEN_ALL) const;
     bool in_check() const;
+    U64 compute_hash() const;
+    int compute_psqt() const;
     Board* copy() const;
     void do_move(U16 move);
 
+    // do_move that can be taken back with unmake_move, in LIFO order, at
+    // most MAX_UNDO deep
+    void make_move(U16 move);
+    void unmake_move();
+
+    // Non-capturing, non-promoting moves the side that just moved could have
+    // played to reach this position, as move(p0, p1) with the piece now on p1.
+    // For retrograde analysis; the position before may leave the other king
+    // in check.
+    void get_retractions(MoveList& moves) const;
+
+    // passes the turn, for null-move pruning. Never while in check.
+    void make_null_move();
+    void unmake_null_move();
+
     private:
-    std::unordered_set<U16> _get_pseudolegal_moves() const;
-    std::unordered_set<U16> _get_pseudolegal_moves_for_piece(U8 piece_pos) const;
+    void _get_pseudolegal_moves(MoveList& moves, GenMode mode) const;
+    void _get_pseudolegal_moves_for_piece(U8 piece_pos, MoveList& moves, GenMode mode) const;
     void _flip_player();
-    void _do_move(U16 move);
+    void _do_move(U16 move, UndoInfo& undo);
     bool _under_threat(U8 piece_pos) const;
-    void _undo_last_move(U16 move);
-    std::unordered_set<U16> _get_pseudolegal_moves_for_side(U8 color) const;
+    bool _is_legal(U16 move) const;
+    void _undo_last_move(const UndoInfo& undo);
+    void _get_pseudolegal_moves_for_side(U8 color, MoveList& moves, GenMode mode) const;
 };
 
 std::string move_to_str(U16 move);
 U16 str_to_move(std::string move);
+std::string position_to_str(const Board& b);
+// false, leaving b alone, if s isn't a position
+bool str_to_position(const std::string& s, Board& b);
 std::string board_to_str(const U8 *b);
 std::string all_boards_to_str(const Board& b);
 char piece_to_char(U8 piece);
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "book.hpp"
+
+Book::~Book() {
+    unload();
+}
+
+void Book::unload() {
+    if (this->addr) munmap(this->addr, this->len);
+    this->addr = nullptr;
+    this->len = 0;
+    this->entries = nullptr;
+    this->n = 0;
+    this->file.clear();
+}
+
+bool Book::load(const std::string& path) {
+
+    unload();
+    this->file = path;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(BookHeader)) {
+        addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+
+    BookHeader header;
+    memcpy(&header, addr, sizeof(header));
+    if (memcmp(header.magic, BOOK_MAGIC, 4) != 0 || header.version != BOOK_VERSION
+        || (size_t)st.st_size != sizeof(BookHeader) + header.n_entries * sizeof(BookEntry)) {
+        munmap(addr, st.st_size);
+        return false;
+    }
+
+    this->addr = addr;
+    this->len = st.st_size;
+    this->entries = (const BookEntry*)((const U8*)addr + sizeof(BookHeader));
+    this->n = header.n_entries;
+    return true;
+}
+
+void Book::find(const Board& b, const BookEntry*& first, const BookEntry*& last) const {
+
+    U64 key = b.data.hash;
+    first = std::lower_bound(this->entries, this->entries + this->n, key,
+                             [](const BookEntry& e, U64 k) { return e.key < k; });
+    last = first;
+    while (last != this->entries + this->n && last->key == key) last++;
+}
+
+U16 Book::pick(const Board& b, std::mt19937& rng) const {
+
+    const BookEntry *first, *last;
+    find(b, first, last);
+    if (first == last) return 0;
+
+    // a hash collision or a stale book can hand back moves that don't
+    // belong to this position
+    MoveList legal = b.get_legal_moves();
+    uint32_t total = 0;
+    for (const BookEntry *e = first; e != last; e++) {
+        if (legal.contains(e->move)) total += e->weight;
+    }
+    if (total == 0) return 0;
+
+    uint32_t r = std::uniform_int_distribution<uint32_t>(0, total - 1)(rng);
+    for (const BookEntry *e = first; e != last; e++) {
+        if (!legal.contains(e->move)) continue;
+        if (r < e->weight) return e->move;
+        r -= e->weight;
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <random>
+#include <string>
+
+#include "board.hpp"
+
+// Opening book, written by bookgen and memory-mapped for lookup.
+//
+// The file is a header followed by BookEntry records sorted by key, then
+// move. The moves of a position are one contiguous run, found by binary
+// search straight on the mapping.
+
+#define BOOK_MAGIC "RBBK"
+#define BOOK_VERSION 1
+
+struct BookHeader {
+    char magic[4];   // "RBBK"
+    uint32_t version;
+    uint64_t n_entries;
+};
+
+struct BookEntry {
+    U64 key;         // Board::data.hash of the position
+    U16 move;
+    U16 weight;      // relative, a move is played in proportion to it
+    uint32_t pad;
+};
+
+class Book {
+
+    public:
+
+    ~Book();
+
+    // maps the book at path, replacing anything loaded before. False if
+    // there is no valid book there; the path is remembered either way.
+    bool load(const std::string& path);
+    void unload();
+    const std::string& path() const { return this->file; }
+    size_t size() const { return this->n; }
+
+    // the entries for b as [first, last), empty if b isn't in the book
+    void find(const Board& b, const BookEntry*& first, const BookEntry*& last) const;
+
+    // a legal book move for b picked in proportion to the weights, 0 if
+    // the book has none
+    U16 pick(const Board& b, std::mt19937& rng) const;
+
+    private:
+
+    void *addr = nullptr;
+    size_t len = 0;
+    const BookEntry *entries = nullptr;
+    size_t n = 0;
+    std::string file;
+};
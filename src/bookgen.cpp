@@ -0,0 +1,211 @@
+#include <popl.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "board.hpp"
+#include "book.hpp"
+#include "engine.hpp"
+
+// Builds the opening book from games, either read from a log or played
+// here by the engine against itself. Each move in the first plies of a
+// game counts for the position it was played from: twice when the side
+// that played it went on to win, once for a draw, not at all for a loss.
+//
+// A game log has one game per line: the moves from the start position,
+// then optionally 1-0, 0-1 or 1/2-1/2 for the result, White first.
+
+#define RESULT_WHITE 1
+#define RESULT_BLACK -1
+#define RESULT_DRAW 0
+
+struct Game {
+    std::vector<U16> moves;
+    int result = RESULT_DRAW;
+};
+
+// position key -> move -> weight
+typedef std::unordered_map<U64, std::map<U16, uint32_t>> BookCounts;
+
+bool parse_game(const std::string& line, Game& game) {
+
+    std::istringstream ss(line);
+    std::string tok;
+    Board b;
+    while (ss >> tok) {
+        if (tok == "1-0" || tok == "0-1" || tok == "1/2-1/2") {
+            game.result = tok == "1-0" ? RESULT_WHITE : tok == "0-1" ? RESULT_BLACK : RESULT_DRAW;
+            break;
+        }
+        U16 m = str_to_move(tok);
+        if (!b.get_legal_moves().contains(m)) {
+            std::cout << "ERROR: illegal move " << tok << std::endl;
+            return false;
+        }
+        b.do_move(m);
+        game.moves.push_back(m);
+    }
+    return true;
+}
+
+std::string game_to_str(const Game& game) {
+    std::string s;
+    for (U16 m : game.moves) s += move_to_str(m) + " ";
+    return s + (game.result == RESULT_WHITE ? "1-0" : game.result == RESULT_BLACK ? "0-1" : "1/2-1/2");
+}
+
+// the first random_plies moves are picked at random so that the games
+// spread out, the rest by the engine
+Game play_game(Engine& e, int random_plies, int max_plies, std::mt19937& rng) {
+
+    Game game;
+    Board b;
+    for (int ply=0; ply<max_plies; ply++) {
+        MoveList moves = b.get_legal_moves();
+        if (moves.empty()) {
+            // mated, or a stalemate which stays a draw
+            if (b.in_check()) game.result = b.data.player_to_play == WHITE ? RESULT_BLACK : RESULT_WHITE;
+            return game;
+        }
+
+        U16 m;
+        if (ply < random_plies) {
+            m = moves[std::uniform_int_distribution<size_t>(0, moves.size() - 1)(rng)];
+        }
+        else {
+            e.search = true;
+            e.find_best_move(b);
+            m = e.best_move;
+        }
+        b.do_move(m);
+        game.moves.push_back(m);
+    }
+    return game;
+}
+
+void count_game(const Game& game, int book_plies, BookCounts& counts) {
+
+    Board b;
+    for (int ply=0; ply<(int)game.moves.size() && ply<book_plies; ply++) {
+        int mover = b.data.player_to_play == WHITE ? RESULT_WHITE : RESULT_BLACK;
+        int weight = game.result == RESULT_DRAW ? 1 : game.result == mover ? 2 : 0;
+        if (weight) counts[b.data.hash][game.moves[ply]] += weight;
+        b.do_move(game.moves[ply]);
+    }
+}
+
+bool write_book(const std::string& path, const BookCounts& counts, uint32_t min_weight) {
+
+    std::vector<BookEntry> entries;
+    size_t positions = 0;
+    for (auto& pos : counts) {
+        size_t before = entries.size();
+        for (auto& mw : pos.second) {
+            if (mw.second < min_weight) continue;
+            BookEntry entry = {};
+            entry.key = pos.first;
+            entry.move = mw.first;
+            entry.weight = (U16)std::min<uint32_t>(mw.second, UINT16_MAX);
+            entries.push_back(entry);
+        }
+        if (entries.size() > before) positions++;
+    }
+    std::sort(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) {
+        return a.key != b.key ? a.key < b.key : a.move < b.move;
+    });
+
+    BookHeader header = {};
+    memcpy(header.magic, BOOK_MAGIC, 4);
+    header.version = BOOK_VERSION;
+    header.n_entries = entries.size();
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(entries.data(), sizeof(BookEntry), entries.size(), f) == entries.size();
+    bool closed = fclose(f) == 0;
+    if (ok && closed) {
+        std::cout << "wrote " << entries.size() << " entries for " << positions << " positions to " << path << std::endl;
+    }
+    return ok && closed;
+}
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Usage: bookgen [options]\n"
+                          "Builds the opening book from a game log, or from self-play games when no log is given");
+    std::string out, games_in, games_out;
+    int n_games, movetime, depth, random_plies, book_plies, max_plies, min_weight, seed;
+    auto help_op = op.add<popl::Switch>("h", "help", "print this message");
+    op.add<popl::Value<std::string>>("o", "out", "book file to write", "book.rbk", &out);
+    auto games_op = op.add<popl::Value<std::string>>("g", "games", "game log to build from instead of playing", "", &games_in);
+    op.add<popl::Value<std::string>>("l", "log", "also append the self-play games to this log", "", &games_out);
+    op.add<popl::Value<int>>("n", "n-games", "self-play games to play", 64, &n_games);
+    op.add<popl::Value<int>>("t", "movetime", "self-play search time per move in ms", 200, &movetime);
+    op.add<popl::Value<int>>("d", "depth", "self-play search depth per move instead of a time", 0, &depth);
+    op.add<popl::Value<int>>("r", "random-plies", "self-play plies played at random at the start", 1, &random_plies);
+    op.add<popl::Value<int>>("m", "max-plies", "self-play plies before a game is scored a draw", 300, &max_plies);
+    op.add<popl::Value<int>>("p", "book-plies", "plies of each game that go into the book", 16, &book_plies);
+    op.add<popl::Value<int>>("w", "min-weight", "least weight a move needs to be kept", 2, &min_weight);
+    op.add<popl::Value<int>>("s", "seed", "seed for the random plies", 1, &seed);
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+
+    BookCounts counts;
+
+    if (games_op->is_set()) {
+        std::ifstream in(games_in);
+        if (!in) {
+            std::cout << "ERROR: could not read " << games_in << std::endl;
+            return 1;
+        }
+        std::string line;
+        int n = 0;
+        while (std::getline(in, line)) {
+            Game game;
+            if (!parse_game(line, game)) return 1;
+            if (game.moves.empty()) continue;
+            count_game(game, book_plies, counts);
+            n++;
+        }
+        std::cout << "read " << n << " games" << std::endl;
+    }
+    else {
+        Engine e;
+        e.own_book = false;
+        e.movetime_ms = depth > 0 ? 0 : movetime;
+        e.depth_limit = depth;
+
+        std::ofstream log;
+        if (!games_out.empty()) log.open(games_out, std::ios::app);
+
+        std::mt19937 rng(seed);
+        int results[3] = {};  // black wins, draws, white wins
+        for (int i=0; i<n_games; i++) {
+            Game game = play_game(e, random_plies, max_plies, rng);
+            count_game(game, book_plies, counts);
+            results[game.result + 1]++;
+            if (log.is_open()) log << game_to_str(game) << std::endl;
+            std::cout << "game " << i + 1 << " " << game_to_str(game) << std::endl;
+        }
+        std::cout << "white wins " << results[2] << " black wins " << results[0] << " draws " << results[1] << std::endl;
+    }
+
+    if (!write_book(out, counts, min_weight)) {
+        std::cout << "ERROR: could not write " << out << std::endl;
+        return 1;
+    }
+    return 0;
+}
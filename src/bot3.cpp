@@ -106,9 +106,9 @@ std::pair<U16, double> minimax_node(Board* b, int depth, std::atomic<bool>& sear
             ex = 6 - ex;
             ey = 6 - ey;
         }
-        Board *_b = b->copy();
-        _b->do_move(curr);
-        auto adversary = minimax_node(_b, depth+1, search, -ismax);
+        b->make_move(curr);
+        auto adversary = minimax_node(b, depth+1, search, -ismax);
+        b->unmake_move();
         if (adversary.first != 0xfffe){
             if (ismax * adversary.second > ismax * best_pair.second){
                 best_pair = {curr, adversary.second};
@@ -153,10 +153,12 @@ std::pair<U16, double> minimax_node(Board* b, int depth, std::atomic<bool>& sear
     }
     return best_pair;
 }   
+void Engine::start() {}
+
 void Engine::find_best_move(const Board& b) {
 
     maxD = 0;
-    Board *_b = b.copy();
+    Board _b = b;
     auto moveset = b.get_legal_moves();
     if (moveset.size() == 0) {
         this->best_move = 0;
@@ -165,7 +167,7 @@ void Engine::find_best_move(const Board& b) {
         while(search){
             maxD += 1;
             // maxD = 2;
-            auto best_pair = minimax_node(_b, 0, search, 1);
+            auto best_pair = minimax_node(&_b, 0, search, 1);
             if (best_pair.first != 0xfffe and best_pair.first != 0xffff) this->best_move = best_pair.first;
             std::cout << this->best_move << " " << maxD << std::endl;
         }
@@ -3,211 +3,160 @@
 #include <iostream>
 #include <limits>
 #include <chrono>
-#include <bitset>
 #include <math.h>
+#include <memory>
+#include <thread>
 
 #include "board.hpp"
 #include "engine.hpp"
+#include "tt.hpp"
+#include "ordering.hpp"
+#include "book.hpp"
+#include "eval_tables.hpp"
+#include "tablebase.hpp"
 
 typedef uint8_t U8;
 typedef uint16_t U16;
 
-int global_cutoff = 4;
-std::vector<std::string> moves_taken;
-std::vector<U8> last_killed_pieces;
-std::vector<int> last_killed_pieces_idx;
-
-float MinVal(Board *b, float alpha, float beta, int cutoff);
-float MaxVal(Board *b, float alpha, float beta, int cutoff);
-
-constexpr U8 cw_90[64] = {
-    48, 40, 32, 24, 16, 8, 0, 7,
-    49, 41, 33, 25, 17, 9, 1, 15,
-    50, 42, 18, 19, 20, 10, 2, 23,
-    51, 43, 26, 27, 28, 11, 3, 31,
-    52, 44, 34, 35, 36, 12, 4, 39,
-    53, 45, 37, 29, 21, 13, 5, 47,
-    54, 46, 38, 30, 22, 14, 6, 55,
-    56, 57, 58, 59, 60, 61, 62, 63};
-
-constexpr U8 acw_90[64] = {
-    6, 14, 22, 30, 38, 46, 54, 7,
-    5, 13, 21, 29, 37, 45, 53, 15,
-    4, 12, 18, 19, 20, 44, 52, 23,
-    3, 11, 26, 27, 28, 43, 51, 31,
-    2, 10, 34, 35, 36, 42, 50, 39,
-    1, 9, 17, 25, 33, 41, 49, 47,
-    0, 8, 16, 24, 32, 40, 48, 55,
-    56, 57, 58, 59, 60, 61, 62, 63};
-
-constexpr U8 cw_180[64] = {
-    54, 53, 52, 51, 50, 49, 48, 7,
-    46, 45, 44, 43, 42, 41, 40, 15,
-    38, 37, 18, 19, 20, 33, 32, 23,
-    30, 29, 26, 27, 28, 25, 24, 31,
-    22, 21, 34, 35, 36, 17, 16, 39,
-    14, 13, 12, 11, 10, 9, 8, 47,
-    6, 5, 4, 3, 2, 1, 0, 55,
-    56, 57, 58, 59, 60, 61, 62, 63};
-
-constexpr U8 id[64] = {
-    0, 1, 2, 3, 4, 5, 6, 7,
-    8, 9, 10, 11, 12, 13, 14, 15,
-    16, 17, 18, 19, 20, 21, 22, 23,
-    24, 25, 26, 27, 28, 29, 30, 31,
-    32, 33, 34, 35, 36, 37, 38, 39,
-    40, 41, 42, 43, 44, 45, 46, 47,
-    48, 49, 50, 51, 52, 53, 54, 55,
-    56, 57, 58, 59, 60, 61, 62, 63};
-
-void do_move(Board *b, U16 move)
+TranspositionTable tt;
+
+// Iterative deepening stops at this depth even if there is time left.
+#define MAX_DEPTH 64
+// Nodes searched between checks of the stop flag and the clock.
+#define CHECK_EVERY_NODES 1024
+// Plies of quiescence below the horizon before we take the static eval anyway.
+// Captures run out on their own, but check evasions can go on for a while.
+#define MAX_QDEPTH 16
+
+// Search scores are integers in centipawns. The float terms of eval_fn are
+// in units of half a pawn, scaled by EVAL_SCALE. Mates are scored
+// MATE_SCORE minus the plies to get there.
+#define EVAL_SCALE 50
+#define INF_SCORE 1000000
+#define MATE_SCORE 100000
+#define MATE_BOUND (MATE_SCORE - 1000)
+// Slack for delta pruning: a capture is skipped when even winning the piece
+// plus this much can't lift the static eval to alpha.
+#define DELTA_MARGIN 100
+// Half width of the first aspiration window around the last iteration's
+// score, and the depth from which iterations use one.
+#define ASPIRATION_DELTA 25
+#define ASPIRATION_MIN_DEPTH 4
+// Null-move pruning is tried from this depth, with one more ply of
+// reduction from NULL_MOVE_DEEP_DEPTH on.
+#define NULL_MOVE_MIN_DEPTH 3
+#define NULL_MOVE_DEEP_DEPTH 6
+// Late move reductions apply from this depth; the reduction grows by a ply
+// for moves past LMR_DEEP_MOVES at LMR_DEEP_DEPTH and beyond.
+#define LMR_MIN_DEPTH 3
+#define LMR_DEEP_DEPTH 6
+#define LMR_DEEP_MOVES 8
+
+// The soft time budget is scaled after each iteration: down to
+// TIME_STABLE_PCT percent once the best move has held for TIME_STABLE_ITERS
+// iterations, to TIME_CHANGED_PCT percent when the best move changed since
+// the last iteration, and up to TIME_FAIL_LOW_PCT percent after a fail-low
+// at the root or a score drop of TIME_DROP_CP. It never goes past the hard
+// deadline.
+#define TIME_STABLE_ITERS 3
+#define TIME_STABLE_PCT 50
+#define TIME_CHANGED_PCT 130
+#define TIME_FAIL_LOW_PCT 200
+#define TIME_DROP_CP 30
+
+// Stop conditions shared by all search threads. They are set up before the
+// threads start and only read while they run, except for the deadline of a
+// ponder search which the first thread to see the ponderhit arms.
+const Engine *search_engine = nullptr;
+const std::atomic<bool> *search_flag = nullptr;
+const std::atomic<bool> *pondering_flag = nullptr;
+std::atomic<bool> awaiting_ponderhit(false);
+std::chrono::milliseconds movetime(0);
+std::atomic<bool> has_deadline(false);
+std::atomic<std::chrono::steady_clock::time_point> deadline;
+// when our clock started running: the search start, or the ponderhit
+std::atomic<std::chrono::steady_clock::time_point> clock_start;
+// raised by the main thread when it is done, to send the helpers home
+std::atomic<bool> helpers_stop(false);
+
+// Endgame tables, reloaded when the Engine's tb_path changes and only read
+// while a search runs.
+Tablebases tablebases;
+
+// Opening book, reloaded when the Engine's book_path changes.
+Book book;
+std::mt19937 book_rng(std::random_device{}());
+
+// The Engine's selectivity options, copied when a search starts.
+struct SearchOptions
 {
-
-    U8 p0 = getp0(move);
-    U8 p1 = getp1(move);
-    U8 promo = getpromo(move);
-    U8 piecetype = b->data.board_0[p0];
-    last_killed_pieces.push_back(0);
-    last_killed_pieces_idx.push_back(-1);
-
-    // scan and get piece from coord
-    U8 *pieces = (U8 *)b;
-    for (int i = 0; i < 12; i++)
-    {
-        if (pieces[i] == p1)
-        {
-            pieces[i] = DEAD;
-            last_killed_pieces.back() = b->data.board_0[p1];
-            last_killed_pieces_idx.back() = i;
-        }
-        if (pieces[i] == p0)
-        {
-            pieces[i] = p1;
-        }
-    }
-
-    if (promo == PAWN_ROOK)
-    {
-        piecetype = (piecetype & (WHITE | BLACK)) | ROOK;
-    }
-    else if (promo == PAWN_BISHOP)
-    {
-        piecetype = (piecetype & (WHITE | BLACK)) | BISHOP;
-    }
-
-    b->data.board_0[p1] = piecetype;
-    b->data.board_90[cw_90[p1]] = piecetype;
-    b->data.board_180[cw_180[p1]] = piecetype;
-    b->data.board_270[acw_90[p1]] = piecetype;
-
-    b->data.board_0[p0] = 0;
-    b->data.board_90[cw_90[p0]] = 0;
-    b->data.board_180[cw_180[p0]] = 0;
-    b->data.board_270[acw_90[p0]] = 0;
-
-    b->data.player_to_play = (PlayerColor)(b->data.player_to_play ^ (WHITE | BLACK)); // flipping player
-    // std::cout << "Did last move\n";
-    // std::cout << all_boards_to_str(*this);
-}
-
-void undo_last_move(Board *b, U16 move)
+    bool null_move;
+    int null_move_r;
+    bool lmr;
+    int lmr_full_moves;
+} options;
+
+// Everything one search thread writes. Threads only share the
+// transposition table and the stop conditions above.
+struct SearchThread
 {
-
-    U8 p0 = getp0(move);
-    U8 p1 = getp1(move);
-    U8 promo = getpromo(move);
-
-    U8 piecetype = b->data.board_0[p1];
-    U8 deadpiece = 0;
-
-    // scan and get piece from coord
-    U8 *pieces = (U8 *)(&(b->data));
-    for (int i = 0; i < 12; i++)
-    {
-        if (pieces[i] == p1)
-        {
-            pieces[i] = p0;
-            break;
-        }
-    }
-
-    if (last_killed_pieces_idx.back() != -1)
-    {
-        deadpiece = last_killed_pieces.back(); // updating deadpiece if there is something in vector
-        pieces[last_killed_pieces_idx.back()] = p1;
-    }
-
-    last_killed_pieces.pop_back();
-    last_killed_pieces_idx.pop_back();
-
-    if (promo == PAWN_ROOK)
+    int id = 0;
+    Board board;
+    MoveOrdering ordering;
+    U16 root_best_move = 0;   // best root move found so far in that iteration
+    // Counters kept per thread and only added up when reported. nodes and
+    // tbhits are published every CHECK_EVERY_NODES nodes for the main thread.
+    U64 nodes = 0;
+    U64 tbhits = 0;
+    int seldepth = 0;
+    int fail_lows = 0;        // root fail-lows in the current iteration
+    std::atomic<U64> nodes_reported{0};
+    std::atomic<U64> tbhits_reported{0};
+    // Once set, every node unwinds without storing anything and the
+    // unfinished iteration is thrown away.
+    bool aborted = false;
+};
+
+bool should_abort(SearchThread &t)
+{
+    if (t.aborted)
     {
-        piecetype = ((piecetype & (WHITE | BLACK)) ^ ROOK) | PAWN;
+        return true;
     }
-    else if (promo == PAWN_BISHOP)
+    if (++t.nodes % CHECK_EVERY_NODES == 0)
     {
-        piecetype = ((piecetype & (WHITE | BLACK)) ^ BISHOP) | PAWN;
-    }
-
-    b->data.board_0[p0] = piecetype;
-    b->data.board_90[cw_90[p0]] = piecetype;
-    b->data.board_180[cw_180[p0]] = piecetype;
-    b->data.board_270[acw_90[p0]] = piecetype;
-
-    b->data.board_0[p1] = deadpiece;
-    b->data.board_90[cw_90[p1]] = deadpiece;
-    b->data.board_180[cw_180[p1]] = deadpiece;
-    b->data.board_270[acw_90[p1]] = deadpiece;
-
-    b->data.player_to_play = (PlayerColor)(b->data.player_to_play ^ (WHITE | BLACK)); // flipping player again
-
-    // std::cout << "Undid last move\n";
-    // std::cout << all_boards_to_str(*this);
-}
-// No of white - No of black
-float material_check(Board *b)
-{
-    float val = 0;
-    // float weight_arr[12] = {8, 8, 0, 4, 2, 2, 8, 8, 0, 4, 2, 2};
-    float p = 2, bi = 4, r = 8;
-    U8 *pieces = (U8 *)(&(b->data));
-    for (int i = 0; i < 12; i++)
-    {
-        int temp = 0;
-        if (pieces[i] != DEAD)
+        t.nodes_reported.store(t.nodes, std::memory_order_relaxed);
+        t.tbhits_reported.store(t.tbhits, std::memory_order_relaxed);
+        if (awaiting_ponderhit && !(*pondering_flag) && awaiting_ponderhit.exchange(false))
         {
-            // val += (((int(i >= 6) - int(i < 6))) * weight_arr[i])* (pieces[i] != DEAD);
-
-            U8 piecetype = b->data.board_0[pieces[i]];
-            temp += ((piecetype & PAWN) == PAWN) * p;
-            temp += ((piecetype & BISHOP) == BISHOP) * bi;
-            temp += ((piecetype & ROOK) == ROOK) * r;
-            temp *= std::pow(-1, (piecetype & BLACK) == BLACK);
+            movetime = std::chrono::milliseconds(search_engine->movetime_ms);
+            clock_start = std::chrono::steady_clock::now();
+            deadline = clock_start.load() + movetime;
+            has_deadline = movetime.count() > 0;
         }
-        val += temp;
+        t.aborted = !(*search_flag) || helpers_stop || (has_deadline && std::chrono::steady_clock::now() >= deadline.load());
     }
-    return val;
+    return t.aborted;
 }
 
 float check_condition(Board *b)
 {
     //
     float val = 0;
-    bool player = (b->data.player_to_play == WHITE); // current player
+    float sign = (b->data.player_to_play == WHITE) ? -1 : 1; // being in check is bad for the current player
     if (b->in_check())
     {
-        // if white is in check, bad, negative
-        val = 10 * std::pow(-1, int(player));
+        val = 10 * sign;
         if (b->get_legal_moves().size() == 0) // if you're checkmated
         {
-            val += 500 * std::pow(-1, int(player));
+            val += 500 * sign;
         }
     }
     return val;
 }
 
 // Calculates how ranges covered + threats given
-float range_and_threats(Board *b, std::unordered_set<U16> moves, float range_weight, float threat_weight)
+float range_and_threats(Board *b, MoveList moves, float range_weight, float threat_weight)
 {
     bool player = (b->data.player_to_play == WHITE);
     float val = 0;
@@ -215,7 +164,7 @@ float range_and_threats(Board *b, std::unordered_set<U16> moves, float range_wei
     U8 *pieces = (U8 *)(&(b->data));
 
     b->data.player_to_play = (PlayerColor)(b->data.player_to_play ^ (WHITE | BLACK)); // flipping player
-    std::unordered_set<U16> moves_flip = b->get_legal_moves();
+    MoveList moves_flip = b->get_legal_moves();
     b->data.player_to_play = (PlayerColor)(b->data.player_to_play ^ (WHITE | BLACK)); // flipping player back so as to not interfere with remaining processes
 
     // moves = (player == 1) ? moves : moves_flip; //White's moves
@@ -225,7 +174,10 @@ float range_and_threats(Board *b, std::unordered_set<U16> moves, float range_wei
 
     /*Taking union -> Note: we dont need to care about coinciding positions because if there existed coinciding
     positions it implies there was no oponent piece in that square in first place */
-    moves.insert(moves_flip.begin(), moves_flip.end());
+    for (auto m : moves_flip)
+    {
+        moves.push(m);
+    }
 
     // Calculating threats
     for (auto m : moves)
@@ -249,135 +201,82 @@ float range_and_threats(Board *b, std::unordered_set<U16> moves, float range_wei
     return val;
 }
 
+// Pawns are scored by how far the enemy king trails them round the ring.
 float pawn_distance(Board *b)
 {
     float val = 0;
-    // the below are the proper non-overlapping sector regions.
-    std::unordered_set<U8> bottom({1, 2, 3, 4, 5, 6, 10, 11, 12, 13});
-    std::unordered_set<U8> left({0, 8, 16, 24, 32, 40, 9, 17, 25, 33});
-    std::unordered_set<U8> top({48, 49, 50, 51, 52, 53, 41, 42, 43, 44});
-    std::unordered_set<U8> right({54, 46, 38, 30, 22, 14, 45, 37, 29, 21});
-    U8 corners[4] = {pos(5, 1), pos(1, 1), pos(1, 5), pos(5, 5)};
-    U8 *pieces = (U8 *)(&(b->data));
-
-    int ids[4] = {4, 5, 10, 11};
-    for (int i = 0; i < 4; i++) // for each piece
+    for (int c = 0; c < 2; c++)
     {
-        std::bitset<4> piece_arr;
-        std::bitset<4> king_arr;
-        U8 piece_pos = pieces[ids[i]];
-        U8 king_pos = pieces[(i > 5) * 2 + (i <= 5) * 8];
-        U8 piecetype = b->data.board_0[piece_pos];
-
-        if (piece_pos == DEAD || (piecetype & PAWN) != PAWN)
+        U64 pawns = b->data.bb_pieces[c][piece_idx(PAWN)];
+        U64 enemy_king = b->data.bb_pieces[c ^ 1][piece_idx(KING)];
+        if (!enemy_king)
+        {
             continue;
-        piece_arr[0] = bottom.count(piece_pos);
-        piece_arr[1] = left.count(piece_pos);
-        piece_arr[2] = top.count(piece_pos);
-        piece_arr[3] = right.count(piece_pos);
-        king_arr[0] = bottom.count(king_pos);
-        king_arr[1] = left.count(king_pos);
-        king_arr[2] = top.count(king_pos);
-        king_arr[3] = right.count(king_pos);
-        int sector_dist = (int)std::log2((piece_arr.to_ulong() << 4) / king_arr.to_ulong()) % 4;
-        int piece_c = 0;
-        int king_c = 0;
-        for (int i = 0; i < 4; i++)
-        {
-            piece_c += (int)piece_arr[i] * corners[i];
-            king_c += (int)king_arr[i] * corners[i];
-        }
-        int piece_dist = std::abs(getx(piece_pos) - getx(piece_c)) + std::abs(gety(piece_pos) - gety(piece_c));
-        int king_dist = std::abs(getx(king_pos) - getx(king_c)) + std::abs(gety(king_pos) - gety(king_c));
-        int diff = king_dist - piece_dist;
-        if (diff < 0)
-            diff += 40;
-        int total_dist = diff + 4 * sector_dist;
-        val -= total_dist * std::pow(-1, (piecetype & BLACK) == BLACK);
+        }
+        U8 king_pos = __builtin_ctzll(enemy_king);
+        int sign = (c == color_idx(WHITE)) ? 1 : -1;
+        for (; pawns; pawns &= pawns - 1)
+        {
+            val -= pawn_king_distance.dist[__builtin_ctzll(pawns)][king_pos] * sign;
+        }
     }
     return val;
 }
 
+// Rooks, promoted pawns included, are scored by the sector they hold
+// relative to the enemy king.
 float rook_distance(Board *b)
 {
     float val = 0;
-    // std::unordered_set<U8> bottom({1, 2, 3, 4, 5, 6, 10, 11, 12, 13});
-    // std::unordered_set<U8> left({0, 8, 16, 24, 32, 40, 9, 17, 25, 33});
-    // std::unordered_set<U8> top({48, 49, 50, 51, 52, 53, 41, 42, 43, 44});
-    // std::unordered_set<U8> right({54, 46, 38, 30, 22, 14, 45, 37, 29, 21});
-
-    std::unordered_set<U8> bottom_r({2, 3, 4, 5, 6, 10, 11, 12, 13, 14});
-    std::unordered_set<U8> left_r({0, 1, 8, 9, 16, 24, 32, 17, 25, 33});
-    std::unordered_set<U8> top_r({50, 51, 52, 42, 43, 44, 40, 41, 48, 49});
-    std::unordered_set<U8> right_r({54, 46, 38, 30, 22, 14, 45, 37, 29, 21});
-
-    std::unordered_set<U8> bottom_l({0, 1, 8, 9, 2, 3, 4, 10, 11, 12});
-    std::unordered_set<U8> left_l({40, 41, 48, 49, 16, 24, 32, 17, 25, 33});
-    std::unordered_set<U8> top_l({45, 46, 53, 54, 50, 51, 52, 42, 43, 44});
-    std::unordered_set<U8> right_l({5, 6, 13, 14, 38, 30, 22, 37, 29, 21});
-    U8 *pieces = (U8 *)(&(b->data));
-
-    int ids[8] = {0, 1, 4, 5, 6, 7, 10, 11}; // iterate through rooks and pawns(maybe upgraded)
-    for (int i = 0; i < 8; i++)
+    for (int c = 0; c < 2; c++)
     {
-        std::bitset<4> piece_arr;
-        std::bitset<4> king_arr;
-        U8 piece_pos = pieces[ids[i]];
-        U8 king_pos = pieces[(i > 5) * 2 + (i <= 5) * 8];
-        U8 piecetype = b->data.board_0[piece_pos];
-
-        if (piece_pos == DEAD || (piecetype & ROOK) != ROOK)
+        U64 rooks = b->data.bb_pieces[c][piece_idx(ROOK)];
+        U64 enemy_king = b->data.bb_pieces[c ^ 1][piece_idx(KING)];
+        if (!enemy_king)
+        {
             continue;
-        piece_arr[0] = bottom_r.count(piece_pos);
-        piece_arr[1] = left_r.count(piece_pos);
-        piece_arr[2] = top_r.count(piece_pos);
-        piece_arr[3] = right_r.count(piece_pos);
-        king_arr[0] = bottom_l.count(king_pos);
-        king_arr[1] = left_l.count(king_pos);
-        king_arr[2] = top_l.count(king_pos);
-        king_arr[3] = right_l.count(king_pos);
-        int sector_dist = 0;
-        if ((piece_arr.to_ulong() & piece_arr.to_ulong()) > 0)
-            sector_dist = 5;
-        else
-            sector_dist = (int)std::log2((piece_arr.to_ulong() << 4) / king_arr.to_ulong()) % 4; // 0 to 3
-
-        // std::cout << "rook:" << rook_arr.to_ulong() << "king:" << king_arr.to_ulong() << "\n";
-
-        val -= 8 * sector_dist * std::pow(-1, (piecetype & BLACK) == BLACK);
+        }
+        U8 king_pos = __builtin_ctzll(enemy_king);
+        int sign = (c == color_idx(WHITE)) ? 1 : -1;
+        for (; rooks; rooks &= rooks - 1)
+        {
+            val -= 8 * rook_king_sector.dist[__builtin_ctzll(rooks)][king_pos] * sign;
+        }
     }
     return val;
 }
 
-float eval_fn(Board *b)
+// Material and piece-square values come from the board, which updates them
+// as moves are made and unmade. Only the dynamic terms are computed here.
+int eval_fn(Board *b)
 {
     float final_val = 0;
-    final_val += 1 * material_check(b);
     final_val += 1 * check_condition(b);
-    // final_val += 0.01 * pawn_distance(b);
-    // final_val += 0.02 * rook_distance(b);
-    return final_val;
+    final_val += 0.01 * pawn_distance(b);
+    final_val += 0.02 * rook_distance(b);
+    return b->data.psqt + (int)std::lround(final_val * EVAL_SCALE);
+}
+
+// eval_fn from the side to move's point of view, as negamax wants it
+int evaluate(Board *b)
+{
+    int val = eval_fn(b);
+    return b->data.player_to_play == WHITE ? val : -val;
 }
 
-void print_state(Board *b, U16 move, int cutoff)
+void print_state(Board *b, U16 move, int ply)
 {
     std::cout << "Present board state:" << std::endl;
     std::cout << all_boards_to_str(*b) << std::endl;
-    std::cout << "Moves taken till now: ";
-    for (auto m : moves_taken)
-    {
-        std::cout << m << " ";
-    }
-    std::cout << std::endl;
     if (move != 0)
     {
         std::cout << "Next Move to take: " << move_to_str(move) << std::endl;
-        std::cout << "Present Depth:" << global_cutoff - cutoff << std::endl;
+        std::cout << "Present Depth:" << ply << std::endl;
         std::cout << "\n";
     }
 }
 
-void print_moveset(std::unordered_set<U16> moveset)
+void print_moveset(const MoveList &moveset)
 {
     std::cout << "Moves that can be taken from this node: ";
     for (auto m : moveset)
@@ -387,119 +286,587 @@ void print_moveset(std::unordered_set<U16> moveset)
     std::cout << std::endl;
 }
 
-U16 best_move_obtained = 0;
+// Material without the square bonus: the piece_material weights board.cpp
+// builds the psqt from, 0 for an empty square or a king.
+int piece_value(U8 piece)
+{
+    if (piece & ROOK)
+    {
+        return 8 * EVAL_SCALE;
+    }
+    if (piece & BISHOP)
+    {
+        return 4 * EVAL_SCALE;
+    }
+    if (piece & PAWN)
+    {
+        return 2 * EVAL_SCALE;
+    }
+    return 0;
+}
+
+// What a capture or promotion gains in material, at most.
+int capture_gain(Board *b, U16 move)
+{
+    int gain = piece_value(b->data.board_0[getp1(move)]);
+    U8 promo = getpromo(move);
+    if (promo == PAWN_ROOK)
+    {
+        gain += piece_value(ROOK) - piece_value(PAWN);
+    }
+    else if (promo == PAWN_BISHOP)
+    {
+        gain += piece_value(BISHOP) - piece_value(PAWN);
+    }
+    return gain;
+}
 
-float unified_minimax(Board *b, int cutoff, float alpha, float beta, bool Maximizing)
+// Mate scores are stored in the transposition table relative to the node,
+// not the root, so they stay right when the position is reached at another ply.
+int score_to_tt(int score, int ply)
 {
-    // bool is_sorted = false;
-    if (cutoff == 0)
+    if (score > MATE_BOUND)
     {
-        return eval_fn(b);
+        return score + ply;
     }
-    std::unordered_set<U16> moveset = b->get_legal_moves();
-    if (moveset.size() == 0)
+    if (score < -MATE_BOUND)
+    {
+        return score - ply;
+    }
+    return score;
+}
+
+int score_from_tt(int score, int ply)
+{
+    if (score > MATE_BOUND)
+    {
+        return score - ply;
+    }
+    if (score < -MATE_BOUND)
+    {
+        return score + ply;
+    }
+    return score;
+}
+
+// Searches captures and promotions below the horizon until the position is
+// quiet, so the static eval is never taken in the middle of an exchange.
+// The side to move may stand pat on the eval unless it is in check, in which
+// case every evasion is searched instead.
+int quiescence(SearchThread &t, int alpha, int beta, int qdepth, int ply)
+{
+    Board *b = &t.board;
+    if (should_abort(t))
+    {
+        return 0;
+    }
+    t.seldepth = std::max(t.seldepth, ply);
+
+    bool evading = b->in_check();
+    int stand_pat = 0;
+    int best_eval = -INF_SCORE;
+    MoveList moveset;
+    if (evading)
+    {
+        b->get_legal_moves(moveset);
+        if (moveset.size() == 0)
+        {
+            return -MATE_SCORE + ply;
+        }
+        if (qdepth >= MAX_QDEPTH)
+        {
+            return evaluate(b);
+        }
+    }
+    else
+    {
+        stand_pat = evaluate(b);
+        if (qdepth >= MAX_QDEPTH || stand_pat >= beta)
+        {
+            return stand_pat;
+        }
+        alpha = std::max(alpha, stand_pat);
+        best_eval = stand_pat;
+        b->get_legal_moves(moveset, GEN_CAPTURES);
+    }
+
+    int scores[MAX_MOVES];
+    t.ordering.score_moves(*b, moveset, scores, 0, MAX_PLY);
+
+    for (int i = 0; i < moveset.size(); i++)
+    {
+        U16 m = pick_next(moveset, scores, i);
+        if (!evading && stand_pat + capture_gain(b, m) + DELTA_MARGIN <= alpha)
+        {
+            continue;
+        }
+
+        b->make_move(m);
+        int eval = -quiescence(t, -beta, -alpha, qdepth + 1, ply + 1);
+        b->unmake_move();
+        if (t.aborted)
+        {
+            return 0;
+        }
+
+        best_eval = std::max(best_eval, eval);
+        alpha = std::max(alpha, eval);
+        if (alpha >= beta)
+        {
+            break;
+        }
+    }
+    return best_eval;
+}
+
+// Whether the side to move has anything besides its king and pawns. Without
+// a rook or bishop, passing is often better than any real move (king and
+// pawn against king on the ring), which is what null-move pruning assumes
+// can't happen.
+bool has_pieces(Board *b)
+{
+    int us = color_idx(b->data.player_to_play);
+    return b->data.bb_pieces[us][piece_idx(ROOK)] | b->data.bb_pieces[us][piece_idx(BISHOP)];
+}
+
+// Exact score from the endgame tables, false if b isn't covered.
+bool probe_tablebases(Board *b, int ply, int &score)
+{
+    int pieces = __builtin_popcountll(b->data.bb_color[0] | b->data.bb_color[1]);
+    if (pieces > tablebases.max_pieces())
+    {
+        return false;
+    }
+    U8 v = tablebases.probe(*b);
+    if (v == TB_ILLEGAL)
+    {
+        return false;
+    }
+    if (v == TB_DRAW)
     {
-        return eval_fn(b);
+        score = 0;
+        return true;
     }
-    // Ordering the values using lambda function:
-    std::vector<U16> ordered_moveset(moveset.begin(), moveset.end());
+    // the side to move is mated after dtm plies, which it delivers when odd
+    int dtm = v - 1;
+    score = (dtm % 2) ? MATE_SCORE - (ply + dtm) : -MATE_SCORE + (ply + dtm);
+    return true;
+}
 
-    auto order_moves = [b](U16 move1, U16 move2)
+// Principal variation search. The first move at each node is searched with
+// the full window; the rest only have to prove they are no better, with a
+// null window, and are searched again in full if one turns out to be.
+// Scores are from the side to move's point of view.
+//
+// Off the principal variation the search is selective: if passing the turn
+// still fails high on a reduced search the node is cut (null-move pruning),
+// and quiet moves ordered late are searched shallower first and only get a
+// full depth search when they beat alpha (late move reductions).
+int negamax(SearchThread &t, int depth, int alpha, int beta, int ply, bool allow_null = true)
+{
+    Board *b = &t.board;
+    if (should_abort(t))
     {
-        do_move(b, move1);
-        float val1 = eval_fn(b);
-        undo_last_move(b, move1);
+        return 0;
+    }
+    t.seldepth = std::max(t.seldepth, ply);
+    int tb_score;
+    if (ply > 0 && probe_tablebases(b, ply, tb_score))
+    {
+        t.tbhits++;
+        return tb_score;
+    }
+    if (depth <= 0)
+    {
+        return quiescence(t, alpha, beta, 0, ply);
+    }
 
-        do_move(b, move2);
-        float val2 = eval_fn(b);
-        undo_last_move(b, move2);
+    // PV nodes always search, so the principal variation comes out of the
+    // search rather than the table. The root keeps searching so that it
+    // always picks a move.
+    bool pv_node = beta - alpha > 1;
+    TTEntry entry;
+    U16 tt_move = 0;
+    if (tt.probe(b->data.hash, entry))
+    {
+        tt_move = entry.move;
+        int tt_score = score_from_tt(entry.score, ply);
+        if (ply > 0 && !pv_node && entry.depth >= depth)
+        {
+            if (entry.bound() == TT_EXACT
+                || (entry.bound() == TT_LOWER && tt_score >= beta)
+                || (entry.bound() == TT_UPPER && tt_score <= alpha))
+            {
+                return tt_score;
+            }
+        }
+    }
+    int alpha_window = alpha;
+    bool in_check = b->in_check();
 
-        return val1 > val2;
-    };
+    if (options.null_move && allow_null && !pv_node && !in_check && ply > 0
+        && depth >= NULL_MOVE_MIN_DEPTH && has_pieces(b) && evaluate(b) >= beta)
+    {
+        int r = options.null_move_r + (depth >= NULL_MOVE_DEEP_DEPTH);
+        b->make_null_move();
+        int eval = -negamax(t, depth - 1 - r, -beta, -beta + 1, ply + 1, false);
+        b->unmake_null_move();
+        if (t.aborted)
+        {
+            return 0;
+        }
+        if (eval >= beta)
+        {
+            // a mate found after passing isn't a real one
+            return eval >= MATE_BOUND ? beta : eval;
+        }
+    }
 
-    std::sort(ordered_moveset.begin(), ordered_moveset.end(), order_moves); // Sorted in descending order
+    MoveList moveset;
+    b->get_legal_moves(moveset);
+    if (moveset.size() == 0)
+    {
+        return in_check ? -MATE_SCORE + ply : 0;
+    }
 
-    // print_moveset(moveset);
-    // std::cout << "\nOrdered Moveset->\n\n";
-    // print_moveset(ordered_moveset);
-    // std::cout << "\n";
+    int scores[MAX_MOVES];
+    t.ordering.score_moves(*b, moveset, scores, tt_move, ply);
 
-    if (Maximizing)
+    int best_eval = -INF_SCORE;
+    U16 best_move = 0;
+    for (int i = 0; i < moveset.size(); i++)
     {
-        float max_eval = std::numeric_limits<float>::lowest();
-        for (auto m : moveset)
+        U16 m = pick_next(moveset, scores, i);
+        bool quiet = !is_capture_or_promo(*b, m);
+        b->make_move(m);
+        int eval;
+        if (i == 0)
         {
-            do_move(b, m);
-            float eval = unified_minimax(b, cutoff - 1, alpha, beta, false);
-            undo_last_move(b, m);
-            max_eval = std::max(max_eval, eval);
-            if (cutoff == global_cutoff && eval > alpha)
+            eval = -negamax(t, depth - 1, -beta, -alpha, ply + 1);
+        }
+        else
+        {
+            int r = 0;
+            if (options.lmr && quiet && !in_check && depth >= LMR_MIN_DEPTH
+                && i >= options.lmr_full_moves && scores[i] < ORDER_KILLER && !b->in_check())
             {
-                best_move_obtained = m;
+                r = 1 + (depth >= LMR_DEEP_DEPTH && i >= LMR_DEEP_MOVES);
             }
-            alpha = std::max(alpha, eval);
-            if (alpha >= beta)
+            eval = -negamax(t, depth - 1 - r, -alpha - 1, -alpha, ply + 1);
+            if (r > 0 && eval > alpha)
             {
-                break;
+                eval = -negamax(t, depth - 1, -alpha - 1, -alpha, ply + 1);
+            }
+            if (eval > alpha && eval < beta)
+            {
+                eval = -negamax(t, depth - 1, -beta, -alpha, ply + 1);
             }
         }
-        return max_eval;
+        b->unmake_move();
+        if (t.aborted)
+        {
+            return 0;
+        }
+
+        if (eval > best_eval)
+        {
+            best_eval = eval;
+            best_move = m;
+        }
+        if (eval > alpha)
+        {
+            alpha = eval;
+            if (ply == 0)
+            {
+                t.root_best_move = m;
+            }
+        }
+        if (alpha >= beta)
+        {
+            if (quiet)
+            {
+                t.ordering.update_cutoff(m, depth, ply);
+            }
+            break;
+        }
     }
-    else
+
+    TTBound bound = TT_EXACT;
+    if (best_eval <= alpha_window)
+    {
+        bound = TT_UPPER;
+    }
+    else if (best_eval >= beta)
     {
-        std::reverse(ordered_moveset.begin(), ordered_moveset.end());
+        bound = TT_LOWER;
+    }
+    tt.store(b->data.hash, score_to_tt(best_eval, ply), best_move, depth, bound);
 
-        float min_eval = std::numeric_limits<float>::max();
-        for (auto m : moveset)
+    return best_eval;
+}
+
+// Search threads, kept between searches so their history tables carry over.
+std::vector<std::unique_ptr<SearchThread>> search_threads;
+
+// One iteration of iterative deepening. From ASPIRATION_MIN_DEPTH on it
+// first searches a narrow window around the previous score and widens the
+// side that failed, doubling the margin each time, until the score lands
+// inside the window.
+int aspiration_search(SearchThread &t, int depth, int prev_value)
+{
+    int delta = ASPIRATION_DELTA;
+    int alpha = -INF_SCORE, beta = INF_SCORE;
+    if (depth >= ASPIRATION_MIN_DEPTH && std::abs(prev_value) < MATE_BOUND)
+    {
+        alpha = prev_value - delta;
+        beta = prev_value + delta;
+    }
+
+    while (true)
+    {
+        int value = negamax(t, depth, alpha, beta, 0);
+        if (t.aborted)
+        {
+            return 0;
+        }
+        if (value <= alpha && alpha > -INF_SCORE)
+        {
+            t.fail_lows++;
+            alpha = std::max(value - delta, -INF_SCORE);
+        }
+        else if (value >= beta && beta < INF_SCORE)
         {
-            do_move(b, m);
-            float eval = unified_minimax(b, cutoff - 1, alpha, beta, true);
-            undo_last_move(b, m);
-            min_eval = std::min(min_eval, eval);
-            if (cutoff == global_cutoff && eval < beta)
+            beta = std::min(value + delta, INF_SCORE);
+        }
+        else
+        {
+            return value;
+        }
+        delta *= 2;
+    }
+}
+
+// The principal variation: the best root move, then the table's moves for
+// as long as they are legal, up to max_len moves and stopping short of a
+// repeated position.
+std::vector<U16> extract_pv(SearchThread &t, int max_len)
+{
+    Board *b = &t.board;
+    std::vector<U16> pv;
+    std::vector<U64> seen;
+    U16 m = t.root_best_move;
+    TTEntry entry;
+    while (m && (int)pv.size() < max_len)
+    {
+        seen.push_back(b->data.hash);
+        b->make_move(m);
+        pv.push_back(m);
+        m = 0;
+        if (tt.probe(b->data.hash, entry) && b->get_legal_moves().contains(entry.move)
+            && std::find(seen.begin(), seen.end(), b->data.hash) == seen.end())
+        {
+            m = entry.move;
+        }
+    }
+    for (size_t i = 0; i < pv.size(); i++)
+    {
+        b->unmake_move();
+    }
+    return pv;
+}
+
+// Moves to mate for a mate score, negative when being mated, 0 otherwise.
+int mate_in(int score)
+{
+    if (score >= MATE_BOUND)
+    {
+        return (MATE_SCORE - score + 1) / 2;
+    }
+    if (score <= -MATE_BOUND)
+    {
+        return -(MATE_SCORE + score) / 2;
+    }
+    return 0;
+}
+
+// Iterative deepening on one thread. Each iteration seeds the next one's
+// move ordering through the transposition table. Helpers on odd ids start a
+// ply deeper so the threads spread over two depths instead of racing through
+// the same tree; they only feed the shared table, and just the main thread's
+// completed iterations are published.
+void iterative_deepening(SearchThread &t, Engine *e, std::chrono::steady_clock::time_point start)
+{
+    int value = 0;
+    int stable = 0;
+    U16 prev_best = 0;
+    int max_depth = e->depth_limit > 0 ? std::min(e->depth_limit, MAX_DEPTH) : MAX_DEPTH;
+    for (int depth = 1 + (t.id & 1); depth <= max_depth; depth++)
+    {
+        int prev_value = value;
+        t.fail_lows = 0;
+        value = aspiration_search(t, depth, value);
+        if (t.aborted)
+        {
+            break;
+        }
+        if (t.id != 0)
+        {
+            continue;
+        }
+
+        std::vector<U16> pv = extract_pv(t, depth);
+        e->best_move = t.root_best_move;
+        e->ponder_move = pv.size() > 1 ? pv[1] : 0;
+        e->depth_reached = depth;
+        t.nodes_reported = t.nodes;
+        t.tbhits_reported = t.tbhits;
+        U64 nodes = 0, tbhits = 0;
+        for (auto &h : search_threads)
+        {
+            nodes += h->nodes_reported.load(std::memory_order_relaxed);
+            tbhits += h->tbhits_reported.load(std::memory_order_relaxed);
+        }
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        if (e->listener)
+        {
+            SearchInfo info;
+            info.depth = depth;
+            info.seldepth = t.seldepth;
+            info.score = value;
+            info.mate = mate_in(value);
+            info.nodes = nodes;
+            info.tbhits = tbhits;
+            info.time_ms = (int)duration.count();
+            info.pv = pv;
+            e->listener->on_info(info);
+        }
+
+        // soft budget: don't start an iteration we have no time for
+        stable = t.root_best_move == prev_best ? stable + 1 : 0;
+        prev_best = t.root_best_move;
+        if (e->soft_time_ms > 0 && !awaiting_ponderhit && depth > 1)
+        {
+            int pct = 100;
+            if (t.fail_lows > 0 || value <= prev_value - TIME_DROP_CP)
+            {
+                pct = TIME_FAIL_LOW_PCT;
+            }
+            else if (stable == 0)
             {
-                best_move_obtained = m;
+                pct = TIME_CHANGED_PCT;
             }
-            beta = std::min(beta, eval);
-            if (alpha >= beta)
+            else if (stable >= TIME_STABLE_ITERS)
+            {
+                pct = TIME_STABLE_PCT;
+            }
+            auto used = std::chrono::steady_clock::now() - clock_start.load();
+            if (used >= std::chrono::milliseconds((int64_t)e->soft_time_ms * pct / 100))
             {
                 break;
             }
         }
-        return min_eval;
     }
 }
 
+void Engine::start()
+{
+}
+
 void Engine::find_best_move(const Board &b)
 {
 
     // pick a random move
 
     auto moveset = b.get_legal_moves();
+    this->ponder_move = 0;
     if (moveset.size() == 0)
     {
         this->best_move = 0;
     }
     else
     {
-        // std::cout << "\n\n\n\n\n\n\nStart find_best_move()\nBoard state:\n";
-        // std::cout << all_boards_to_str(b) << "\n Legal moves:" << std::endl;
-        // for (auto m : moveset)
-        // {
-        //     std::cout << move_to_str(m) << " ";
-        // }
-        // std::cout << std::endl;
-        Board *b_copy = b.copy();
-
-        auto start = std::chrono::high_resolution_clock::now();
-        unified_minimax(b_copy, global_cutoff, std::numeric_limits<float>::lowest(), std::numeric_limits<float>::max(), b.data.player_to_play == WHITE);
-        auto end = std::chrono::high_resolution_clock::now();
-        std::chrono::milliseconds duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-
-        // if (duration.count() < 2000)
-        this->best_move = best_move_obtained;
-        std::cout << "Best move chosen:" << move_to_str(best_move_obtained) << std::endl;
-        delete b_copy;
+        if (this->own_book)
+        {
+            if (this->book_path != book.path())
+            {
+                book.load(this->book_path);
+            }
+            U16 book_move = book.pick(b, book_rng);
+            if (book_move)
+            {
+                this->best_move = book_move;
+                this->nodes_searched = 0;
+                this->depth_reached = 0;
+                std::cout << "Book move chosen:" << move_to_str(book_move) << std::endl;
+                return;
+            }
+        }
+
+        if (tt.size_mb() != (size_t)this->hash_mb)
+        {
+            tt.resize(this->hash_mb);
+        }
+        tt.new_search();
+        if (this->tb_path != tablebases.path())
+        {
+            tablebases.load(this->tb_path);
+        }
+
+        int n_threads = std::max(1, this->threads);
+        search_threads.resize(n_threads);
+        for (int i = 0; i < n_threads; i++)
+        {
+            if (!search_threads[i])
+            {
+                search_threads[i] = std::make_unique<SearchThread>();
+                search_threads[i]->id = i;
+            }
+            SearchThread &t = *search_threads[i];
+            t.board = b;
+            t.root_best_move = 0;
+            t.ordering.age();
+            t.nodes = 0;
+            t.tbhits = 0;
+            t.seldepth = 0;
+            t.nodes_reported = 0;
+            t.tbhits_reported = 0;
+            t.aborted = false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        search_engine = this;
+        search_flag = &this->search;
+        pondering_flag = &this->pondering;
+        movetime = std::chrono::milliseconds(this->movetime_ms);
+        awaiting_ponderhit = this->pondering.load();
+        clock_start = start;
+        deadline = start + movetime;
+        has_deadline = this->movetime_ms > 0 && !awaiting_ponderhit;
+        helpers_stop = false;
+        options = {this->null_move, this->null_move_r, this->lmr, this->lmr_full_moves};
+        this->depth_reached = 0;
+
+        // something legal to play if we are stopped before depth 1 completes
+        this->best_move = moveset[0];
+
+        std::vector<std::thread> helpers;
+        for (int i = 1; i < n_threads; i++)
+        {
+            helpers.emplace_back(iterative_deepening, std::ref(*search_threads[i]), this, start);
+        }
+        iterative_deepening(*search_threads[0], this, start);
+        helpers_stop = true;
+        for (auto &h : helpers)
+        {
+            h.join();
+        }
+        this->nodes_searched = 0;
+        for (auto &h : search_threads)
+        {
+            this->nodes_searched += h->nodes;
+        }
+
+        std::cout << "Best move chosen:" << move_to_str(this->best_move) << std::endl;
     }
 }
 
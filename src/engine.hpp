@@ -2,12 +2,73 @@
 
 #include "board.hpp"
 #include <atomic>
+#include <string>
+
+// What the search reports after each completed iteration.
+struct SearchInfo {
+    int depth;
+    int seldepth;       // deepest ply reached, quiescence included
+    int score;          // centipawns for the side to move
+    int mate;           // moves to mate, negative when being mated, 0 if none
+    U64 nodes;
+    U64 tbhits;
+    int time_ms;
+    std::vector<U16> pv;
+};
+
+// Receives search progress. Called on the search thread, so it should only
+// hand the information on.
+class SearchListener {
+
+    public:
+    virtual ~SearchListener() = default;
+    virtual void on_info(const SearchInfo& info) = 0;
+};
 
 class Engine {
 
     public:
     std::atomic<U16> best_move;
     std::atomic<bool> search;
+    // the reply the search expects to best_move, 0 if it has none
+    std::atomic<U16> ponder_move{0};
+    // set while searching on the opponent's time. Clearing it (ponderhit)
+    // turns the running search into a normal one, with its movetime counted
+    // from then on.
+    std::atomic<bool> pondering{false};
+
+    // UCI options, picked up by the next search
+    int hash_mb = 16;
+    int threads = 1;
+    bool null_move = true;
+    int null_move_r = 2;
+    bool lmr = true;
+    int lmr_full_moves = 3;  // moves searched at full depth before reducing
+    // directory of the tbgen tables, empty for none
+    std::string tb_path = "tb";
+    // play from the bookgen book while it has the position
+    bool own_book = true;
+    std::string book_path = "book.rbk";
+
+    // Wall-clock limit for the next search in milliseconds, 0 searches until
+    // search is cleared, and the time after which it starts no new
+    // iteration, scaled by how settled the best move is, 0 for none. For a
+    // ponder search both count from the ponderhit and may be changed until
+    // then.
+    std::atomic<int> movetime_ms{0};
+    std::atomic<int> soft_time_ms{0};
+    // deepest iteration of the next search, 0 for no limit
+    int depth_limit = 0;
+
+    // told about every completed iteration, if set
+    SearchListener *listener = nullptr;
+
+    // what the last search got through, both 0 for a book move
+    U64 nodes_searched = 0;
+    int depth_reached = 0;
 
+    // called once on the main thread before the first search, for set-up
+    // that has to outlive the threads searches run on
+    void start();
     virtual void find_best_move(const Board& b);
 };
@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <random>
 #include <iostream>
+#include <cassert>
 
 #include "board.hpp"
 #include "engine.hpp"
@@ -30,25 +31,70 @@
 
 namespace py = pybind11;
 
+// What the Python engine gets besides the board: Engine::search, which it
+// should poll so that it returns once the search is stopped.
+struct SearchToken {
+    const std::atomic<bool> *search;
 
-void Engine::find_best_move(const Board& b) {
-    // py::scoped_interpreter guard{};  // Start the Python interpreter
-    py::scoped_interpreter guard{};  // Start the Python interpreter
-
-    std::cout << "Starting Best Move" << std::endl;
-    std::cout << "Loading Module" << std::endl;
-    
-    std::cout << "Module almost Loaded" << std::endl;
-    py::module my_module;
-    try{
-        my_module = py::module::import("engine");
-    }catch(const std::exception& e){
+    bool stopped() const { return !*this->search; }
+};
+
+PYBIND11_EMBEDDED_MODULE(rollerball_search, m) {
+    py::class_<SearchToken>(m, "SearchToken")
+        .def("stopped", &SearchToken::stopped);
+}
+
+// The interpreter, engine.py and its find_best_move are set up by
+// Engine::start on the main thread and kept for the whole process. They are
+// never torn down, so exit doesn't have to wait for a search that still
+// holds the GIL. The main thread gives up the GIL once set up; each search
+// thread takes it while it runs.
+struct PythonEngine {
+    py::object find_best_move;   // null if engine.py failed to load
+};
+
+PythonEngine *python = nullptr;
+
+void Engine::start() {
+
+    if (python) return;
+
+    std::cout << "Starting Python" << std::endl;
+    py::initialize_interpreter();
+
+    python = new PythonEngine();
+    try {
+        // registers SearchToken with pybind11
+        py::module::import("rollerball_search");
+        python->find_best_move = py::module::import("engine").attr("find_best_move");
+        std::cout << "Module Loaded" << std::endl;
+    }
+    catch (const std::exception& e) {
         std::cout << "Error: " << e.what() << std::endl;
     }
-    
-    std::cout << "Module Loaded" << std::endl;
-    py::object find_best_move_func = my_module.attr("find_best_move");
+
+    PyEval_SaveThread();
+}
+
+void Engine::find_best_move(const Board& b) {
+
+    assert(python);
+
+    // a new thread runs each search, so this also sets up its thread state
+    py::gil_scoped_acquire gil;
+
+    if (!python->find_best_move) {
+        auto moves = b.get_legal_moves();
+        this->best_move = moves.empty() ? 0 : moves[0];
+        return;
+    }
+
     std::cout << "In find_best_move" << std::endl;
-    this->best_move = find_best_move_func(b).cast<int>();
+    try {
+        this->best_move = python->find_best_move(b, SearchToken{&this->search}).cast<int>();
+    }
+    catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << std::endl;
+    }
     std::cout << "Best Move Found" << std::endl;
-}
\ No newline at end of file
+}
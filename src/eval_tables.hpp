@@ -0,0 +1,142 @@
+#pragma once
+
+#include "board.hpp"
+
+// Ring geometry for the evaluation, all worked out at compile time.
+//
+// The ring is split into four sectors in the order a pawn travels through
+// them: bottom, left, top, right. A pawn sector is the 2 wide strip along
+// one edge; the rook and king partitions below instead pair a 2x2 corner
+// block with the strip in front of it, shifted one way for rooks and the
+// other way for kings.
+
+#define NO_SECTOR -1
+
+// Corner each pawn sector is measured from, by sector.
+constexpr U8 sector_corner[4] = { pos(5,1), pos(1,1), pos(1,5), pos(5,5) };
+
+constexpr U8 pawn_sector_squares[4][10] = {
+    {  1,  2,  3,  4,  5,  6, 10, 11, 12, 13 },  // bottom
+    {  0,  8, 16, 24, 32, 40,  9, 17, 25, 33 },  // left
+    { 48, 49, 50, 51, 52, 53, 41, 42, 43, 44 },  // top
+    { 54, 46, 38, 30, 22, 14, 45, 37, 29, 21 },  // right
+};
+
+constexpr U8 rook_sector_squares[4][10] = {
+    {  5,  6, 13, 14,  2,  3,  4, 10, 11, 12 },
+    {  0,  1,  8,  9, 16, 24, 32, 17, 25, 33 },
+    { 40, 41, 48, 49, 50, 51, 52, 42, 43, 44 },
+    { 53, 54, 45, 46, 38, 30, 22, 37, 29, 21 },
+};
+
+constexpr U8 king_sector_squares[4][10] = {
+    {  0,  1,  8,  9,  2,  3,  4, 10, 11, 12 },
+    { 40, 41, 48, 49, 16, 24, 32, 17, 25, 33 },
+    { 45, 46, 53, 54, 50, 51, 52, 42, 43, 44 },
+    {  5,  6, 13, 14, 38, 30, 22, 37, 29, 21 },
+};
+
+struct SectorMap {
+    int8_t of[64];
+};
+
+constexpr SectorMap build_sector_map(const U8 (&squares)[4][10]) {
+    SectorMap m = {};
+    for (int p=0; p<64; p++) m.of[p] = NO_SECTOR;
+    for (int s=0; s<4; s++) {
+        for (int i=0; i<10; i++) m.of[squares[s][i]] = (int8_t)s;
+    }
+    return m;
+}
+
+// whether the four sectors cover the 40 ring squares exactly once
+constexpr bool is_ring_partition(const U8 (&squares)[4][10]) {
+    U64 seen = 0;
+    for (int s=0; s<4; s++) {
+        for (int i=0; i<10; i++) {
+            U8 p = squares[s][i];
+            bool on_ring = getx(p) < 7 && gety(p) < 7
+                && !(getx(p) >= 2 && getx(p) <= 4 && gety(p) >= 2 && gety(p) <= 4);
+            if (!on_ring || (seen & sq_bb(p))) return false;
+            seen |= sq_bb(p);
+        }
+    }
+    return true;
+}
+
+static_assert(is_ring_partition(pawn_sector_squares), "pawn sectors must split the ring");
+static_assert(is_ring_partition(rook_sector_squares), "rook sectors must split the ring");
+static_assert(is_ring_partition(king_sector_squares), "king sectors must split the ring");
+
+constexpr SectorMap pawn_sector = build_sector_map(pawn_sector_squares);
+constexpr SectorMap rook_sector = build_sector_map(rook_sector_squares);
+constexpr SectorMap king_sector = build_sector_map(king_sector_squares);
+
+constexpr int abs_diff(int a, int b) { return a > b ? a - b : b - a; }
+
+// Manhattan distance from every square to every sector corner.
+struct CornerDistances {
+    U8 to[64][4];
+};
+
+constexpr CornerDistances build_corner_distances() {
+    CornerDistances d = {};
+    for (int p=0; p<64; p++) {
+        for (int s=0; s<4; s++) {
+            d.to[p][s] = (U8)(abs_diff(getx(p), getx(sector_corner[s])) + abs_diff(gety(p), gety(sector_corner[s])));
+        }
+    }
+    return d;
+}
+
+constexpr CornerDistances corner_distance = build_corner_distances();
+
+// How many sectors a is ahead of b in the direction pawns travel.
+constexpr int sector_offset(int a, int b) { return (a - b) & 3; }
+
+// For a pawn on p and the enemy king on k: how far the king trails the pawn
+// round the ring, counting whole sectors as 4 and the gap inside a sector
+// by the distance of each to its sector's corner. 0 off the ring.
+struct PawnKingDistances {
+    U8 dist[64][64];
+};
+
+constexpr PawnKingDistances build_pawn_king_distances() {
+    PawnKingDistances t = {};
+    for (int p=0; p<64; p++) {
+        for (int k=0; k<64; k++) {
+            int sp = pawn_sector.of[p];
+            int sk = pawn_sector.of[k];
+            if (sp == NO_SECTOR || sk == NO_SECTOR) continue;
+
+            int diff = corner_distance.to[k][sk] - corner_distance.to[p][sp];
+            if (diff < 0) diff += 40;
+            t.dist[p][k] = (U8)(diff + 4 * sector_offset(sp, sk));
+        }
+    }
+    return t;
+}
+
+constexpr PawnKingDistances pawn_king_distance = build_pawn_king_distances();
+
+// For a rook on r and the enemy king on k: 5 when the rook's sector lines
+// up with the king's, otherwise how many sectors the rook is ahead. 0 off
+// the ring.
+struct RookKingSectors {
+    U8 dist[64][64];
+};
+
+constexpr RookKingSectors build_rook_king_sectors() {
+    RookKingSectors t = {};
+    for (int r=0; r<64; r++) {
+        for (int k=0; k<64; k++) {
+            int sr = rook_sector.of[r];
+            int sk = king_sector.of[k];
+            if (sr == NO_SECTOR || sk == NO_SECTOR) continue;
+            t.dist[r][k] = (U8)(sr == sk ? 5 : sector_offset(sr, sk));
+        }
+    }
+    return t;
+}
+
+constexpr RookKingSectors rook_king_sector = build_rook_king_sectors();
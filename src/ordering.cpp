@@ -0,0 +1,98 @@
+#include <cstring>
+#include <utility>
+#include "ordering.hpp"
+
+// victim values for MVV-LVA, in proportion to the piece_material weights
+// behind the board's psqt
+static int mvv_value(U8 piece) {
+    if (piece & ROOK) return 8;
+    if (piece & BISHOP) return 4;
+    if (piece & PAWN) return 2;
+    return 0;
+}
+
+// attacker order for MVV-LVA, cheapest first
+static int lva_rank(U8 piece) {
+    if (piece & PAWN) return 0;
+    if (piece & BISHOP) return 1;
+    if (piece & ROOK) return 2;
+    return 3;
+}
+
+void MoveOrdering::clear() {
+    memset(this->killers, 0, sizeof(this->killers));
+    memset(this->history, 0, sizeof(this->history));
+}
+
+void MoveOrdering::age() {
+    memset(this->killers, 0, sizeof(this->killers));
+    for (int i=0; i<64; i++) {
+        for (int j=0; j<64; j++) {
+            this->history[i][j] /= 2;
+        }
+    }
+}
+
+bool is_capture_or_promo(const Board& b, U16 move) {
+    return b.data.board_0[getp1(move)] || getpromo(move);
+}
+
+void MoveOrdering::score_moves(const Board& b, const MoveList& moves, int *scores, U16 tt_move, int ply) const {
+
+    const U16 *killer = (ply < MAX_PLY) ? this->killers[ply] : nullptr;
+
+    for (int i=0; i<moves.size(); i++) {
+        U16 m = moves[i];
+        U8 p0 = getp0(m);
+        U8 p1 = getp1(m);
+
+        if (m == tt_move) {
+            scores[i] = ORDER_TT_MOVE;
+        }
+        else if (is_capture_or_promo(b, m)) {
+            int victim = mvv_value(b.data.board_0[p1]);
+            if (getpromo(m) == PAWN_ROOK) victim += mvv_value(ROOK) - mvv_value(PAWN);
+            else if (getpromo(m) == PAWN_BISHOP) victim += mvv_value(BISHOP) - mvv_value(PAWN);
+            scores[i] = ORDER_CAPTURE + victim * 16 - lva_rank(b.data.board_0[p0]);
+        }
+        else if (killer && m == killer[0]) {
+            scores[i] = ORDER_KILLER + 1;
+        }
+        else if (killer && m == killer[1]) {
+            scores[i] = ORDER_KILLER;
+        }
+        else {
+            scores[i] = this->history[p0][p1];
+        }
+    }
+}
+
+void MoveOrdering::update_cutoff(U16 move, int depth, int ply) {
+
+    if (ply < MAX_PLY && this->killers[ply][0] != move) {
+        this->killers[ply][1] = this->killers[ply][0];
+        this->killers[ply][0] = move;
+    }
+
+    int& h = this->history[getp0(move)][getp1(move)];
+    h += depth * depth;
+    if (h >= HISTORY_MAX) {
+        for (int i=0; i<64; i++) {
+            for (int j=0; j<64; j++) {
+                this->history[i][j] /= 2;
+            }
+        }
+    }
+}
+
+U16 pick_next(MoveList& moves, int *scores, int i) {
+
+    int best = i;
+    for (int j=i+1; j<moves.size(); j++) {
+        if (scores[j] > scores[best]) best = j;
+    }
+    std::swap(moves.moves[i], moves.moves[best]);
+    std::swap(scores[i], scores[best]);
+
+    return moves[i];
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "board.hpp"
+
+// Plies from the root that get their own killer slots.
+#define MAX_PLY 64
+
+// Sort keys, highest first. Every capture or promotion sorts above the
+// killers, which sort above any history score.
+#define ORDER_TT_MOVE  (1 << 30)
+#define ORDER_CAPTURE  (1 << 24)
+#define ORDER_KILLER   (1 << 22)
+#define HISTORY_MAX    (1 << 20)
+
+// Search state that decides which move gets tried first. Moves are scored
+// once per node with score_moves, then pulled out best first with
+// pick_next, so a node that cuts off early doesn't pay for a full sort.
+struct MoveOrdering {
+
+    U16 killers[MAX_PLY][2];  // last two quiet moves that caused a cutoff at each ply
+    int history[64][64];      // [from][to], how often a quiet move caused a cutoff
+
+    MoveOrdering() { clear(); }
+
+    void clear();
+
+    // halves the history so older cutoffs count for less in the next search
+    void age();
+
+    void score_moves(const Board& b, const MoveList& moves, int *scores, U16 tt_move, int ply) const;
+
+    // records that the quiet move caused a beta cutoff at depth plies left
+    void update_cutoff(U16 move, int depth, int ply);
+};
+
+bool is_capture_or_promo(const Board& b, U16 move);
+
+// swaps the best scored move still left into position i and returns it
+U16 pick_next(MoveList& moves, int *scores, int i);
@@ -0,0 +1,168 @@
+#include <popl.hpp>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "board.hpp"
+
+// Leaf node counts for the start position and a handful of positions
+// reached from it, taken from the original get_legal_moves. Any change to
+// move generation has to reproduce these exactly.
+struct PerftPosition {
+    const char* name;
+    const char* moves;   // played from the start position
+    std::vector<U64> counts; // counts[d-1] is perft(d)
+};
+
+#define MIDGAME "c1b2 e6f5 c2b3 c6b6 b3a4 b6a6 a4a5 d6e6 a5b6 c7b7 d2c2 e6d6 " \
+    "c2b1 f5g4 b1a2 d7c6 d1b3 e7f6 b6c6"
+#define ENDGAME MIDGAME " d6e7 e1f1 a6c6 f1e1 e7d7 e1f1 f6g5 e2d2 d7e7 f1e1 " \
+    "c6b6 b3a4 b7d7 e1b1 e7f6 b1c1 f6f5 c1b1 g5f4 d2e2 b6b5 e2c2 b5a5 a4c6 " \
+    "a5b7 b1c1 b7a7 c6d7 f5g6 c1a1 g4f3 a1b1 a7b7 b2a3 b7c7 b1c1 f4g3 a3b4 " \
+    "g3g2 b4b5 g2f1 b5c6 c7b7 d7f3 g6g5 c2d2 b7g6 c1d1 f1e2 d2c2 g5f4 c2c1 " \
+    "g6f6 c6d7 f6f5"
+
+static const std::vector<PerftPosition> suite = {
+    {"startpos", "",
+        {7, 49, 476, 4652, 53771, 622173, 8049487}},
+    {"check", MIDGAME,
+        {4, 67, 1017, 17691, 259247}},
+    {"captures", "c1b1 e6f6 e1f1 f6g5 d2c1 e7f6 c2b3 c7b7 f1e1 d6e7 e2c2 "
+        "g5g4 e1f1 f6f5 b3a4 e7f7 a4b5 f7f6 d1e2 c6c7 c2d2 f5f4 f1f2 g4f3 "
+        "e2a4 b7a7 d2a2 f6f5 f2c2 f3g2 c1b2 g2f1 b5a6 d7c6 b2c1 c7g5 a2a1 "
+        "g5g3 c2b2 a7c7 b2b6 f5g4 c1c2 c6b5 c2b2 g4f3 b6e6",
+        {23, 354, 7301, 113241, 2209071}},
+    {"promotion", ENDGAME,
+        {18, 120, 2222, 20410, 371353}},
+    {"promoted", ENDGAME " d1e1 e2d2 e1f1 f5f6 a2b1 d2c1r",
+        {3, 34, 617, 7846, 150783, 2029339}},
+    {"endgame", ENDGAME " d1e1 e2d2 e1f1 f5f6 a2b1 d2c1r f1c1 f6e6",
+        {18, 133, 2193, 18989, 322249}},
+};
+
+U64 perft(Board& b, int depth) {
+
+    MoveList moves;
+    b.get_legal_moves(moves);
+    if (depth <= 1) return depth == 1 ? moves.size() : 1;
+
+    U64 nodes = 0;
+    for (U16 m : moves) {
+        b.make_move(m);
+        nodes += perft(b, depth - 1);
+        b.unmake_move();
+    }
+    return nodes;
+}
+
+U64 divide(Board& b, int depth) {
+
+    MoveList moves;
+    b.get_legal_moves(moves);
+
+    U64 nodes = 0;
+    for (U16 m : moves) {
+        b.make_move(m);
+        U64 n = perft(b, depth - 1);
+        b.unmake_move();
+        std::cout << move_to_str(m) << ": " << n << std::endl;
+        nodes += n;
+    }
+    return nodes;
+}
+
+// plays a space separated move list from the start position
+bool setup(Board& b, const std::string& moves) {
+
+    std::istringstream ss(moves);
+    std::string tok;
+    while (ss >> tok) {
+        U16 m = str_to_move(tok);
+        if (!b.get_legal_moves().contains(m)) {
+            std::cout << "ERROR: illegal move " << tok << std::endl;
+            return false;
+        }
+        b.do_move(m);
+    }
+    return true;
+}
+
+double elapsed_s(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(U64 nodes, double secs) {
+    std::cout << "nodes " << nodes << " time " << (int)(secs * 1000) << "ms nps "
+              << (U64)(nodes / (secs > 0 ? secs : 1e-9)) << std::endl;
+}
+
+int run_suite(int max_depth) {
+
+    U64 total = 0;
+    double total_s = 0;
+    int failures = 0;
+
+    for (const auto& pos : suite) {
+        Board b;
+        if (!setup(b, pos.moves)) return 1;
+
+        int depth = (int)pos.counts.size();
+        if (max_depth > 0 && max_depth < depth) depth = max_depth;
+
+        auto start = std::chrono::steady_clock::now();
+        U64 nodes = perft(b, depth);
+        double secs = elapsed_s(start);
+        total += nodes;
+        total_s += secs;
+
+        bool ok = nodes == pos.counts[depth - 1];
+        if (!ok) failures++;
+        std::cout << (ok ? "ok   " : "FAIL ") << pos.name << " depth " << depth
+                  << " expected " << pos.counts[depth - 1] << " ";
+        report(nodes, secs);
+    }
+
+    std::cout << "total ";
+    report(total, total_s);
+    if (failures) std::cout << failures << " position(s) failed" << std::endl;
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Usage: perft [options] [moves from startpos...]\n"
+                          "Without a depth, runs the reference suite");
+    int depth, max_depth;
+    auto help_op = op.add<popl::Switch>("h", "help", "print this message");
+    auto depth_op = op.add<popl::Value<int>>("d", "depth", "perft depth", 0, &depth);
+    auto max_op = op.add<popl::Value<int>>("m", "max-depth", "cap the suite depth", 0, &max_depth);
+    auto divide_op = op.add<popl::Switch>("", "divide", "print node counts per root move");
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+
+    if (depth <= 0) {
+        if (!op.non_option_args().empty()) {
+            std::cout << "ERROR: moves given without a depth" << std::endl;
+            return 1;
+        }
+        return run_suite(max_depth);
+    }
+
+    std::string moves;
+    for (const auto& tok : op.non_option_args()) moves += tok + " ";
+
+    Board b;
+    if (!setup(b, moves)) return 1;
+
+    auto start = std::chrono::steady_clock::now();
+    U64 nodes = divide_op->is_set() ? divide(b, depth) : perft(b, depth);
+    report(nodes, elapsed_s(start));
+
+    return 0;
+}
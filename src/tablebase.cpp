@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tablebase.hpp"
+
+// piece types in TBMaterial order
+constexpr U8 tb_types[3] = { ROOK, BISHOP, PAWN };
+constexpr char tb_letters[3] = { 'R', 'B', 'P' };
+
+struct RingIndex {
+    int8_t of[64];     // -1 off the ring
+    U8 square[TB_RING_SQUARES];
+};
+
+constexpr RingIndex build_ring_index() {
+    RingIndex r = {};
+    int n = 0;
+    for (int p=0; p<64; p++) {
+        bool on_ring = getx(p) < 7 && gety(p) < 7
+            && !(getx(p) >= 2 && getx(p) <= 4 && gety(p) >= 2 && gety(p) <= 4);
+        r.of[p] = on_ring ? (int8_t)n : -1;
+        if (on_ring) r.square[n++] = (U8)p;
+    }
+    return r;
+}
+
+constexpr RingIndex ring = build_ring_index();
+
+constexpr U8 rotate_180(U8 p) { return pos(6 - getx(p), 6 - gety(p)); }
+
+uint32_t TBMaterial::key() const {
+    uint32_t k = 0;
+    for (int c=0; c<2; c++) {
+        for (int t=0; t<3; t++) k = (k << 3) | this->counts[c][t];
+    }
+    return k;
+}
+
+int TBMaterial::n_pieces() const {
+    int n = 2;
+    for (int c=0; c<2; c++) {
+        for (int t=0; t<3; t++) n += this->counts[c][t];
+    }
+    return n;
+}
+
+bool TBMaterial::needs_flip() const {
+    const U8 *w = this->counts[color_idx(WHITE)];
+    const U8 *b = this->counts[color_idx(BLACK)];
+    int nw = w[0] + w[1] + w[2], nb = b[0] + b[1] + b[2];
+    if (nw != nb) return nb > nw;
+    return std::lexicographical_compare(w, w + 3, b, b + 3);
+}
+
+TBMaterial TBMaterial::flipped() const {
+    TBMaterial m;
+    for (int t=0; t<3; t++) {
+        m.counts[0][t] = this->counts[1][t];
+        m.counts[1][t] = this->counts[0][t];
+    }
+    return m;
+}
+
+std::string TBMaterial::name() const {
+    std::string s;
+    for (int c : { color_idx(WHITE), color_idx(BLACK) }) {
+        if (!s.empty()) s += 'v';
+        s += 'K';
+        for (int t=0; t<3; t++) s += std::string(this->counts[c][t], tb_letters[t]);
+    }
+    return s;
+}
+
+TBLayout TBMaterial::layout() const {
+    TBLayout l;
+    l.pieces[l.n++] = WHITE | KING;
+    l.pieces[l.n++] = BLACK | KING;
+    for (PlayerColor c : { WHITE, BLACK }) {
+        for (int t=0; t<3; t++) {
+            for (int i=0; i<this->counts[color_idx(c)][t]; i++) l.pieces[l.n++] = c | tb_types[t];
+        }
+    }
+    return l;
+}
+
+TBMaterial tb_material(const Board& b) {
+    TBMaterial m;
+    for (int c=0; c<2; c++) {
+        for (int t=0; t<3; t++) {
+            m.counts[c][t] = (U8)__builtin_popcountll(b.data.bb_pieces[c][piece_idx(tb_types[t])]);
+        }
+    }
+    return m;
+}
+
+size_t tb_size(int n) {
+    size_t size = 2;
+    for (int i=0; i<n; i++) size *= TB_RING_SQUARES;
+    return size;
+}
+
+// Index layout: side to move in the lowest bit, then one ring square per
+// piece in layout order. Identical pieces are indexed in ascending order.
+bool tb_index(const Board& b, const TBLayout& layout, bool flip, size_t& index) {
+
+    U8 squares[TB_MAX_PIECES];
+    for (int i=0; i<layout.n; ) {
+        // the board's pieces of this type are the table's pieces of the other
+        // colour when flipped
+        U8 piece = layout.pieces[i];
+        U8 c = color_idx(piece) ^ (flip ? 1 : 0);
+        int j = i;
+        for (U64 bb = b.data.bb_pieces[c][piece_idx(piece)]; bb; bb &= bb-1) {
+            U8 p = __builtin_ctzll(bb);
+            squares[j++] = flip ? rotate_180(p) : p;
+        }
+        std::sort(squares + i, squares + j);
+        i = j;
+    }
+
+    bool black = (b.data.player_to_play == BLACK) != flip;
+    index = 0;
+    for (int i=layout.n-1; i>=0; i--) {
+        int r = ring.of[squares[i]];
+        if (r < 0) return false;
+        index = index * TB_RING_SQUARES + r;
+    }
+    index = index * 2 + (black ? 1 : 0);
+    return true;
+}
+
+bool tb_setup(Board& b, const TBLayout& layout, size_t index) {
+
+    BoardData& d = b.data;
+    U8 *slots = (U8*)&d;
+    for (int i=0; i<12; i++) slots[i] = DEAD;
+    memset(d.board_0, 0, sizeof(d.board_0));
+    memset(d.bb_pieces, 0, sizeof(d.bb_pieces));
+    memset(d.bb_color, 0, sizeof(d.bb_color));
+    d.hash = 0;
+    d.psqt = 0;
+    b.undo_top = 0;
+
+    d.player_to_play = (index & 1) ? BLACK : WHITE;
+    if (index & 1) d.hash ^= zobrist.black_to_play;
+    index >>= 1;
+
+    int prev_ring = -1;
+    for (int i=0; i<layout.n; i++) {
+        U8 piece = layout.pieces[i];
+        int r = index % TB_RING_SQUARES;
+        index /= TB_RING_SQUARES;
+
+        if (i > 0 && piece == layout.pieces[i-1] && r <= prev_ring) return false;
+        prev_ring = r;
+
+        U8 p = ring.square[r];
+        if (d.board_0[p]) return false;
+
+        // kings have fixed slots, everything else takes the colour's next free one
+        U8 *slot = (piece == (WHITE | KING)) ? &d.w_king : (piece == (BLACK | KING)) ? &d.b_king : nullptr;
+        for (int s=0; !slot && s<6; s++) {
+            U8 *candidate = slots + (color_idx(piece) ? 6 : 0) + s;
+            if (*candidate == DEAD && candidate != &d.w_king && candidate != &d.b_king) slot = candidate;
+        }
+        if (!slot) return false;
+
+        *slot = p;
+        d.board_0[p] = piece;
+        toggle_piece(d, piece, p);
+    }
+
+    return true;
+}
+
+Tablebases::~Tablebases() {
+    unload();
+}
+
+void Tablebases::unload() {
+    for (auto& m : this->mappings) munmap(m.addr, m.len);
+    this->mappings.clear();
+    this->tables.clear();
+    this->dir.clear();
+    this->largest = 0;
+}
+
+void Tablebases::add(const TBMaterial& m, const U8 *entries) {
+    uint32_t key = m.key();
+    auto it = std::lower_bound(this->tables.begin(), this->tables.end(), key,
+                               [](const std::pair<uint32_t, const U8*>& t, uint32_t k) { return t.first < k; });
+    if (it != this->tables.end() && it->first == key) it->second = entries;
+    else this->tables.insert(it, std::make_pair(key, entries));
+    this->largest = std::max(this->largest, m.n_pieces());
+}
+
+int Tablebases::load(const std::string& dir) {
+
+    unload();
+    this->dir = dir;
+
+    DIR *d = opendir(dir.c_str());
+    if (!d) return 0;
+
+    int found = 0;
+    while (struct dirent *ent = readdir(d)) {
+        std::string name = ent->d_name;
+        if (name.size() <= strlen(TB_EXT) || name.compare(name.size() - strlen(TB_EXT), std::string::npos, TB_EXT) != 0) continue;
+
+        std::string path = dir + "/" + name;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) continue;
+
+        struct stat st;
+        void *addr = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TBHeader)) {
+            addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (addr == MAP_FAILED) continue;
+
+        TBHeader header;
+        memcpy(&header, addr, sizeof(header));
+        TBMaterial m;
+        memcpy(m.counts, header.counts, sizeof(m.counts));
+
+        if (memcmp(header.magic, TB_MAGIC, 4) != 0 || header.version != TB_VERSION
+            || (int)header.n_pieces != m.n_pieces() || m.n_pieces() > TB_MAX_PIECES
+            || (size_t)st.st_size != sizeof(TBHeader) + tb_size(m.n_pieces())) {
+            munmap(addr, st.st_size);
+            continue;
+        }
+
+        this->mappings.push_back({addr, (size_t)st.st_size});
+        add(m, (const U8*)addr + sizeof(TBHeader));
+        found++;
+    }
+    closedir(d);
+
+    return found;
+}
+
+U8 Tablebases::probe(const Board& b) const {
+
+    TBMaterial m = tb_material(b);
+    int n = m.n_pieces();
+    if (n == 2) return TB_DRAW;
+    if (n > this->largest) return TB_ILLEGAL;
+
+    bool flip = m.needs_flip();
+    if (flip) m = m.flipped();
+
+    uint32_t key = m.key();
+    auto it = std::lower_bound(this->tables.begin(), this->tables.end(), key,
+                               [](const std::pair<uint32_t, const U8*>& t, uint32_t k) { return t.first < k; });
+    if (it == this->tables.end() || it->first != key) return TB_ILLEGAL;
+
+    size_t index;
+    if (!tb_index(b, m.layout(), flip, index)) return TB_ILLEGAL;
+    return it->second[index];
+}
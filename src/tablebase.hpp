@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "board.hpp"
+
+// Endgame tables, one file per material balance, written by tbgen and
+// memory-mapped for probing.
+//
+// A table holds one byte per position:
+//   TB_DRAW     neither side can force mate
+//   1..254      decided, the side to move is mated after (v-1) plies, so it
+//               wins when v-1 is odd and loses when it is even
+//   TB_ILLEGAL  not a position (the side not to move is in check, two pieces
+//               share a square, ...)
+//
+// Only one colour of each material balance is stored. A position where
+// Black holds the stronger side is rotated by 180 degrees with the colours
+// swapped, which the move rules are symmetric under.
+
+#define TB_MAX_PIECES 5
+#define TB_DRAW 0
+#define TB_ILLEGAL 255
+#define TB_RING_SQUARES 40
+#define TB_EXT ".rtb"
+
+// Pieces of a table in the order they are indexed: white king, black king,
+// then the other white pieces and the other black pieces by type.
+struct TBLayout {
+    int n = 0;
+    U8 pieces[TB_MAX_PIECES];
+};
+
+// Non-king piece counts of each side, [color_idx][rook, bishop, pawn].
+struct TBMaterial {
+    U8 counts[2][3] = {};
+
+    uint32_t key() const;
+    int n_pieces() const;
+    // Black stronger than White, so the table is stored with colours swapped
+    bool needs_flip() const;
+    TBMaterial flipped() const;
+    std::string name() const;
+    TBLayout layout() const;
+};
+
+TBMaterial tb_material(const Board& b);
+// positions in a table with n pieces: side to move times n ring squares
+size_t tb_size(int n);
+// index of b in the table for layout, flipping colours if asked. False if a
+// piece is off the ring.
+bool tb_index(const Board& b, const TBLayout& layout, bool flip, size_t& index);
+// sets up the position at index, false if the index isn't a position
+// (pieces sharing a square, identical pieces out of order)
+bool tb_setup(Board& b, const TBLayout& layout, size_t index);
+
+// result of the side to move, TB_DRAW / distance entry / TB_ILLEGAL
+class Tablebases {
+
+    public:
+
+    ~Tablebases();
+
+    // maps every table in dir, replacing anything loaded before. Returns the
+    // number of tables found.
+    int load(const std::string& dir);
+    void unload();
+    const std::string& path() const { return this->dir; }
+
+    // most pieces, kings included, of any loaded table
+    int max_pieces() const { return this->largest; }
+
+    // The entry for b, TB_ILLEGAL if there is no table for it. Two bare
+    // kings are a draw without a table.
+    U8 probe(const Board& b) const;
+
+    // adds a table held in memory, for tbgen to probe the tables it has
+    // just built
+    void add(const TBMaterial& m, const U8 *entries);
+
+    private:
+
+    struct Mapping {
+        void *addr;
+        size_t len;
+    };
+
+    // (material key, entries), sorted by key. A vector rather than a map so
+    // that this header works after board.hpp, whose move macro breaks the
+    // node-based containers.
+    std::vector<std::pair<uint32_t, const U8*>> tables;
+    std::vector<Mapping> mappings;
+    std::string dir;
+    int largest = 0;
+};
+
+// file layout: header, then tb_size(n) entries
+struct TBHeader {
+    char magic[4];   // "RBTB"
+    uint32_t version;
+    uint32_t n_pieces;
+    U8 counts[2][3];
+    U8 pad[2];
+};
+
+#define TB_MAGIC "RBTB"
+#define TB_VERSION 1
@@ -0,0 +1,273 @@
+#include <popl.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "board.hpp"
+#include "tablebase.hpp"
+
+// Retrograde analysis. Every position of a material balance is first looked
+// at once: mates are lost in 0, moves that capture or promote are settled
+// from the smaller tables, and the rest of the moves are counted. Then, one
+// distance at a time, each position decided at that distance is taken back
+// one move: a predecessor that can move into a loss is won one ply later,
+// and a predecessor whose last undecided move turns out to be a win for the
+// opponent is lost one ply later. Whatever is never decided is a draw.
+
+#define TB_UNDECIDED 0
+
+static U8 entry_for(int dtm) { return (U8)(dtm + 1); }
+
+struct Generator {
+
+    const TBMaterial material;
+    const TBLayout layout;
+    const Tablebases& smaller;
+    const size_t n;
+
+    std::vector<U8> result;
+    std::vector<U8> moves_left;  // moves not yet known to lose
+    std::vector<U8> pending;     // entry this position takes at that distance, from the smaller tables
+    std::vector<U8> exit_loss;   // longest loss through a capture or promotion, as a distance
+
+    Generator(const TBMaterial& m, const Tablebases& smaller)
+        : material(m), layout(m.layout()), smaller(smaller), n(tb_size(m.layout().n)),
+          result(n, TB_UNDECIDED), moves_left(n, 0), pending(n, 0), exit_loss(n, 0) {}
+
+    bool init(size_t index, Board& b);
+    void retract(size_t index, int dtm, Board& b, int& last_pending);
+    bool run();
+};
+
+bool Generator::init(size_t index, Board& b) {
+
+    if (!tb_setup(b, this->layout, index)) {
+        this->result[index] = TB_ILLEGAL;
+        return true;
+    }
+
+    // the side that just moved can't have left its king in check
+    b.make_null_move();
+    bool illegal = b.in_check();
+    b.unmake_null_move();
+    if (illegal) {
+        this->result[index] = TB_ILLEGAL;
+        return true;
+    }
+
+    MoveList moves;
+    b.get_legal_moves(moves);
+    if (moves.empty()) {
+        // mated, or stalemated which stays undecided and so a draw
+        if (b.in_check()) this->result[index] = entry_for(0);
+        return true;
+    }
+
+    int left = 0;
+    for (U16 m : moves) {
+        bool exits = b.data.board_0[getp1(m)] || getpromo(m);
+        if (!exits) {
+            left++;
+            continue;
+        }
+
+        b.make_move(m);
+        U8 child = this->smaller.probe(b);
+        b.unmake_move();
+
+        if (child == TB_ILLEGAL) {
+            std::cout << "ERROR: no table for a move out of " << this->material.name() << std::endl;
+            return false;
+        }
+        if (child == TB_DRAW) {
+            left++;
+            continue;
+        }
+
+        int dtm = child;  // child distance + 1
+        if ((child - 1) % 2 == 0) {
+            // the opponent gets mated, so this position is won. The move
+            // still counts as undecided so the position is never taken as lost.
+            left++;
+            if (!this->pending[index] || entry_for(dtm) < this->pending[index]) this->pending[index] = entry_for(dtm);
+        }
+        else {
+            this->exit_loss[index] = std::max<int>(this->exit_loss[index], dtm);
+        }
+    }
+
+    this->moves_left[index] = (U8)left;
+    if (left == 0 && !this->pending[index]) this->pending[index] = entry_for(this->exit_loss[index]);
+    return true;
+}
+
+void Generator::retract(size_t index, int dtm, Board& b, int& last_pending) {
+
+    tb_setup(b, this->layout, index);
+
+    MoveList retractions;
+    b.get_retractions(retractions);
+
+    for (U16 r : retractions) {
+        b.make_move(move(getp1(r), getp0(r)));
+        size_t prev;
+        tb_index(b, this->layout, false, prev);
+        b.unmake_move();
+
+        if (this->result[prev] != TB_UNDECIDED) continue;
+
+        if (dtm % 2 == 0) {
+            this->result[prev] = entry_for(dtm + 1);
+        }
+        else if (--this->moves_left[prev] == 0) {
+            int loss = std::max(dtm + 1, (int)this->exit_loss[prev]);
+            if (loss == dtm + 1) {
+                this->result[prev] = entry_for(loss);
+            }
+            else {
+                this->pending[prev] = entry_for(loss);
+                last_pending = std::max(last_pending, (int)entry_for(loss));
+            }
+        }
+    }
+}
+
+bool Generator::run() {
+
+    Board b;
+    int last_pending = 0;
+    for (size_t i=0; i<this->n; i++) {
+        if (!init(i, b)) return false;
+        last_pending = std::max(last_pending, (int)this->pending[i]);
+    }
+
+    for (int dtm = 0; ; dtm++) {
+        U8 entry = entry_for(dtm);
+        if (entry >= TB_ILLEGAL) {
+            std::cout << "ERROR: " << this->material.name() << " has mates too long to store" << std::endl;
+            return false;
+        }
+
+        bool any = false;
+        for (size_t i=0; i<this->n; i++) {
+            if (this->result[i] == TB_UNDECIDED && this->pending[i] == entry) this->result[i] = entry;
+            if (this->result[i] != entry) continue;
+            any = true;
+            retract(i, dtm, b, last_pending);
+        }
+
+        if (!any && entry >= last_pending) break;
+    }
+
+    return true;
+}
+
+// every material balance of up to max_pieces pieces, in an order where each
+// table only depends on tables before it: fewer pieces first, then fewer
+// pawns, since promoting trades a pawn for a piece
+std::vector<TBMaterial> all_materials(int max_pieces) {
+
+    std::vector<TBMaterial> materials;
+    int k = max_pieces - 2;
+    for (int wr=0; wr<=k; wr++) for (int wb=0; wb+wr<=k; wb++) for (int wp=0; wp<=2 && wp+wb+wr<=k; wp++)
+    for (int br=0; br+wp+wb+wr<=k; br++) for (int bb=0; bb+br+wp+wb+wr<=k; bb++) for (int bp=0; bp<=2 && bp+bb+br+wp+wb+wr<=k; bp++) {
+        TBMaterial m;
+        U8 *w = m.counts[color_idx(WHITE)], *b = m.counts[color_idx(BLACK)];
+        w[0] = wr; w[1] = wb; w[2] = wp;
+        b[0] = br; b[1] = bb; b[2] = bp;
+        if (m.n_pieces() > 2 && !m.needs_flip()) materials.push_back(m);
+    }
+
+    auto pawns = [](const TBMaterial& m) { return m.counts[0][2] + m.counts[1][2]; };
+    std::stable_sort(materials.begin(), materials.end(), [&](const TBMaterial& a, const TBMaterial& b) {
+        if (a.n_pieces() != b.n_pieces()) return a.n_pieces() < b.n_pieces();
+        return pawns(a) < pawns(b);
+    });
+    return materials;
+}
+
+bool write_table(const std::string& path, const TBMaterial& m, const std::vector<U8>& entries) {
+
+    TBHeader header = {};
+    memcpy(header.magic, TB_MAGIC, 4);
+    header.version = TB_VERSION;
+    header.n_pieces = m.n_pieces();
+    memcpy(header.counts, m.counts, sizeof(header.counts));
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(entries.data(), 1, entries.size(), f) == entries.size();
+    return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Usage: tbgen [options]\n"
+                          "Builds the endgame tables for every material balance up to the given piece count");
+    int max_pieces;
+    std::string dir;
+    auto help_op = op.add<popl::Switch>("h", "help", "print this message");
+    op.add<popl::Value<int>>("n", "pieces", "most pieces per table, kings included", 4, &max_pieces);
+    op.add<popl::Value<std::string>>("o", "out", "directory for the tables", "tb", &dir);
+    auto force_op = op.add<popl::Switch>("f", "force", "rebuild tables that already exist");
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+    if (max_pieces < 3 || max_pieces > TB_MAX_PIECES) {
+        std::cout << "ERROR: pieces must be between 3 and " << TB_MAX_PIECES << std::endl;
+        return 1;
+    }
+
+    mkdir(dir.c_str(), 0755);
+    Tablebases tables;
+    tables.load(dir);
+
+    // tables built in this run, kept in memory for the ones after them
+    std::list<std::vector<U8>> built;
+
+    for (const TBMaterial& m : all_materials(max_pieces)) {
+        std::string path = dir + "/" + m.name() + TB_EXT;
+        struct stat st;
+        if (!force_op->is_set() && stat(path.c_str(), &st) == 0) continue;
+
+        auto start = std::chrono::steady_clock::now();
+        Generator gen(m, tables);
+        if (!gen.run()) return 1;
+
+        size_t counts[3] = {};  // draws, wins, losses
+        int longest = 0;
+        for (U8& v : gen.result) {
+            if (v == TB_ILLEGAL) continue;
+            if (v == TB_DRAW) {
+                counts[0]++;
+                continue;
+            }
+            counts[(v - 1) % 2 ? 1 : 2]++;
+            longest = std::max(longest, v - 1);
+        }
+
+        if (!write_table(path, m, gen.result)) {
+            std::cout << "ERROR: could not write " << path << std::endl;
+            return 1;
+        }
+        built.emplace_back();
+        built.back().swap(gen.result);
+        tables.add(m, built.back().data());
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << m.name() << " wins " << counts[1] << " losses " << counts[2] << " draws " << counts[0]
+                  << " longest mate " << longest << " plies time " << ms << "ms" << std::endl;
+    }
+
+    return 0;
+}
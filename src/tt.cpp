@@ -0,0 +1,98 @@
+#include "tt.hpp"
+
+// data word layout: score | move << 32 | depth << 48 | bound_gen << 56
+static U64 pack(int score, U16 move, int depth, U8 bound_gen) {
+    return (U64)(uint32_t)score | ((U64)move << 32) | ((U64)(U8)depth << 48) | ((U64)bound_gen << 56);
+}
+
+static TTEntry unpack(U64 data) {
+    TTEntry entry;
+    entry.score = (int32_t)(uint32_t)data;
+    entry.move = (U16)(data >> 32);
+    entry.depth = (int8_t)(data >> 48);
+    entry.bound_gen = (U8)(data >> 56);
+    return entry;
+}
+
+TranspositionTable::TranspositionTable(size_t mb) {
+    resize(mb);
+}
+
+void TranspositionTable::resize(size_t mb) {
+
+    // largest power of two number of buckets that fits, so the index is a mask
+    size_t n = 1;
+    while (2 * n * sizeof(TTBucket) <= mb * 1024 * 1024) n *= 2;
+
+    this->buckets.reset(new TTBucket[n]);
+    this->n_buckets = n;
+    this->mb = mb;
+    clear();
+}
+
+void TranspositionTable::clear() {
+    for (size_t i=0; i<this->n_buckets; i++) {
+        for (auto& slot : this->buckets[i].slots) {
+            slot.key_xor_data.store(0, std::memory_order_relaxed);
+            slot.data.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void TranspositionTable::new_search() {
+    this->generation = (this->generation + 1) & 0x3f;
+}
+
+bool TranspositionTable::probe(U64 key, TTEntry& entry) const {
+
+    const TTBucket& bucket = this->buckets[key & (this->n_buckets - 1)];
+
+    for (int i=0; i<TT_BUCKET_SIZE; i++) {
+        U64 data = bucket.slots[i].data.load(std::memory_order_relaxed);
+        U64 key_xor_data = bucket.slots[i].key_xor_data.load(std::memory_order_relaxed);
+        if ((key_xor_data ^ data) == key && (data >> 56 & 0x3) != TT_NONE) {
+            entry = unpack(data);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TranspositionTable::store(U64 key, int score, U16 move, int depth, TTBound bound) {
+
+    TTBucket& bucket = this->buckets[key & (this->n_buckets - 1)];
+
+    // reuse this position's slot if it has one, otherwise evict the entry
+    // that is shallowest once older searches are penalised
+    TTSlot *victim = &bucket.slots[0];
+    TTEntry victim_entry = unpack(victim->data.load(std::memory_order_relaxed));
+    bool same_key = false;
+    int victim_worth = 1 << 30;
+    for (int i=0; i<TT_BUCKET_SIZE; i++) {
+        TTSlot *s = &bucket.slots[i];
+        U64 data = s->data.load(std::memory_order_relaxed);
+        TTEntry e = unpack(data);
+        bool match = (s->key_xor_data.load(std::memory_order_relaxed) ^ data) == key;
+        if (match || e.bound() == TT_NONE) {
+            victim = s;
+            victim_entry = e;
+            same_key = match;
+            break;
+        }
+        int age = (this->generation - e.generation()) & 0x3f;
+        int worth = e.depth - 4 * age;
+        if (worth < victim_worth) {
+            victim = s;
+            victim_entry = e;
+            victim_worth = worth;
+        }
+    }
+
+    // keep the old best move when this search didn't produce one
+    if (move == 0 && same_key) move = victim_entry.move;
+
+    U64 data = pack(score, move, depth, (U8)((this->generation << 2) | bound));
+    victim->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+    victim->data.store(data, std::memory_order_relaxed);
+}
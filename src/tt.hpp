@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "board.hpp"
+
+enum TTBound {
+    TT_NONE  = 0,
+    TT_EXACT = 1,
+    TT_LOWER = 2,  // search failed high, true score >= score
+    TT_UPPER = 3   // search failed low, true score <= score
+};
+
+// What probe hands back, unpacked from a slot's data word.
+struct TTEntry {
+    int32_t score;
+    U16 move;
+    int8_t depth;
+    U8 bound_gen;  // TTBound in the low 2 bits, search generation above
+
+    TTBound bound() const { return (TTBound)(bound_gen & 0x3); }
+    U8 generation() const { return bound_gen >> 2; }
+};
+
+// The table is shared by all search threads without locks. A slot keeps
+// its key XORed with its data, so a slot torn by two threads storing at
+// once no longer matches either key and reads as a miss.
+struct TTSlot {
+    std::atomic<U64> key_xor_data;
+    std::atomic<U64> data;
+};
+
+#define TT_BUCKET_SIZE 4
+
+// one cache line worth of slots, all for the same index
+struct alignas(64) TTBucket {
+    TTSlot slots[TT_BUCKET_SIZE];
+};
+
+class TranspositionTable {
+
+    public:
+
+    TranspositionTable(size_t mb = 16);
+
+    void resize(size_t mb);
+    size_t size_mb() const { return this->mb; }
+    void clear();
+
+    // ages out entries from earlier searches, call before the threads start
+    void new_search();
+
+    bool probe(U64 key, TTEntry& entry) const;
+    void store(U64 key, int score, U16 move, int depth, TTBound bound);
+
+    private:
+
+    std::unique_ptr<TTBucket[]> buckets;
+    size_t n_buckets = 0;
+    size_t mb = 0;
+    U8 generation = 0;
+};
@@ -2,6 +2,7 @@
 #include "uciws.hpp"
 #include "board.hpp"
 
+#include <algorithm>
 #include <string>
 #include <sstream>
 #include <thread>
@@ -26,11 +27,14 @@ std::vector<std::string> split(const std::string &s, char delim) {
 UCIWSServer::UCIWSServer(std::string name, uint32_t port) {
     this->name = name;
     this->port = port;
+    this->base = position_to_str(b);
+    e.listener = this;
 }
 
 void UCIWSServer::handle_message(ClientConnection conn, const std::string& message) {
 
     auto toks = split(message, ' ');
+    if (toks.empty()) return;
 
     if (toks[0] == "uci") {
         on_uci();
@@ -41,15 +45,22 @@ void UCIWSServer::handle_message(ClientConnection conn, const std::string& messa
     else if (toks[0] == "ucinewgame") {
         on_ucinewgame();
     }
+    else if (toks[0] == "setoption") {
+        on_setoption(toks);
+    }
     else if (toks[0] == "position") {
         on_position(toks);
     }
     else if (toks[0] == "go") {
+        requester = conn;
         on_go(toks);
     }
     else if (toks[0] == "stop") {
         on_stop();
     }
+    else if (toks[0] == "ponderhit") {
+        on_ponderhit();
+    }
     else if (toks[0] == "quit") {
         on_quit();
     }
@@ -60,6 +71,8 @@ void UCIWSServer::handle_message(ClientConnection conn, const std::string& messa
 
 void UCIWSServer::start() {
 
+    e.start();
+
     //Register our network callbacks, ensuring the logic is run on the main thread's event loop
     server.connect([this](ClientConnection conn)
     {
@@ -79,8 +92,12 @@ void UCIWSServer::start() {
         });
     });
 
-    server.message([this](ClientConnection conn, const string& message) {
-        this->handle_message(conn, message);
+    server.message([this](ClientConnection conn, const string& message)
+    {
+        main_evt_loop.post([conn, message, this]()
+        {
+            this->handle_message(conn, message);
+        });
     });
     
     //Start the networking thread
@@ -95,6 +112,16 @@ void UCIWSServer::start() {
 
 void UCIWSServer::on_uci() {
     std::cout << "In method on_uci\n";
+    server.broadcastMessage("option name Hash type spin default 16 min 1 max 4096");
+    server.broadcastMessage("option name Threads type spin default 1 min 1 max 256");
+    server.broadcastMessage("option name NullMove type check default true");
+    server.broadcastMessage("option name NullMoveR type spin default 2 min 1 max 4");
+    server.broadcastMessage("option name LMR type check default true");
+    server.broadcastMessage("option name LMRFullMoves type spin default 3 min 1 max 64");
+    server.broadcastMessage("option name TBPath type string default tb");
+    server.broadcastMessage("option name OwnBook type check default true");
+    server.broadcastMessage("option name BookFile type string default book.rbk");
+    server.broadcastMessage("option name Ponder type check default false");
     server.broadcastMessage("uciok");
 }
 
@@ -105,56 +132,334 @@ void UCIWSServer::on_isready() {
 
 void UCIWSServer::on_ucinewgame() {
     std::cout << "In method on_ucinewgame\n";
+    stop_search();
     b = Board();
+    base = position_to_str(b);
+    played.clear();
+    position_ok = true;
+}
+
+void UCIWSServer::on_setoption(std::vector<std::string>& toks) {
+    std::cout << "In method on_setoption\n";
+    // setoption name <id> value <x>
+    if (toks.size() < 5 || toks[1] != "name" || toks[3] != "value") {
+        std::cout << "Malformed setoption\n";
+        return;
+    }
+
+    try {
+        if (toks[2] == "Hash") {
+            e.hash_mb = std::max(1, std::min(4096, std::stoi(toks[4])));
+        }
+        else if (toks[2] == "Threads") {
+            e.threads = std::max(1, std::min(256, std::stoi(toks[4])));
+        }
+        else if (toks[2] == "NullMove") {
+            e.null_move = toks[4] == "true";
+        }
+        else if (toks[2] == "NullMoveR") {
+            e.null_move_r = std::max(1, std::min(4, std::stoi(toks[4])));
+        }
+        else if (toks[2] == "LMR") {
+            e.lmr = toks[4] == "true";
+        }
+        else if (toks[2] == "LMRFullMoves") {
+            e.lmr_full_moves = std::max(1, std::min(64, std::stoi(toks[4])));
+        }
+        else if (toks[2] == "TBPath") {
+            e.tb_path = toks[4] == "<empty>" ? "" : toks[4];
+        }
+        else if (toks[2] == "OwnBook") {
+            e.own_book = toks[4] == "true";
+        }
+        else if (toks[2] == "BookFile") {
+            e.book_path = toks[4];
+        }
+        else if (toks[2] == "Ponder") {
+            ponder = toks[4] == "true";
+        }
+        else {
+            std::cout << "Unsupported option " << toks[2] << "\n";
+        }
+    }
+    catch (const std::exception& ex) {
+        std::cout << "Bad value for option " << toks[2] << "\n";
+    }
 }
 
 void UCIWSServer::on_position(std::vector<std::string>& toks) {
     std::cout << "In method on_position\n";
-    if (toks.size() > 3) {
-        b.do_move(str_to_move(toks[toks.size()-1]));
+    // position startpos [moves m1 m2 ...]
+    // position fen <ranks> <w|b> [moves m1 m2 ...], see position_to_str
+    Board start;
+    size_t i = 2;
+    if (toks.size() > 1 && toks[1] == "startpos") {
+        i = 2;
+    }
+    else if (toks.size() > 3 && toks[1] == "fen" && str_to_position(toks[2] + " " + toks[3], start)) {
+        i = 4;
+    }
+    else {
+        std::cout << "Malformed position\n";
+        position_ok = false;
+        return;
+    }
+
+    std::vector<U16> moves;
+    if (i < toks.size() && toks[i] != "moves") {
+        std::cout << "Malformed position\n";
+        position_ok = false;
+        return;
     }
+    for (i++; i < toks.size(); i++) {
+        if (toks[i].empty()) continue;
+        if (toks[i].size() < 4 || toks[i].size() > 5) {
+            std::cout << "Malformed move " << toks[i] << "\n";
+            position_ok = false;
+            return;
+        }
+        moves.push_back(str_to_move(toks[i]));
+    }
+
+    // ponder hit: the opponent played the reply the running search is on
+    if (ponder_reply) {
+        bool hit = position_to_str(start) == base && moves.size() == played.size() + 1
+            && std::equal(played.begin(), played.end(), moves.begin()) && moves.back() == ponder_reply;
+        if (hit) {
+            std::cout << "Ponder hit\n";
+            ponder_reply = 0;
+        }
+        else {
+            stop_search();
+        }
+    }
+
+    position_ok = sync(start, moves);
+}
+
+// Brings b to start followed by moves. When the game so far is a prefix of
+// that only the new moves are played, otherwise it is replayed from start.
+// An illegal move leaves everything as it was.
+bool UCIWSServer::sync(const Board& start, const std::vector<U16>& moves) {
+
+    std::string start_str = position_to_str(start);
+    size_t common = 0;
+    if (start_str == base) {
+        while (common < played.size() && common < moves.size() && played[common] == moves[common]) common++;
+    }
+    bool replay = start_str != base || common < played.size();
+
+    Board next = replay ? start : b;
+    for (size_t i = replay ? 0 : common; i < moves.size(); i++) {
+        if (!next.get_legal_moves().contains(moves[i])) {
+            std::cout << "Illegal move " << move_to_str(moves[i]) << " in position\n";
+            return false;
+        }
+        next.do_move(moves[i]);
+    }
+
+    if (replay) std::cout << "Replayed " << moves.size() << " moves\n";
+    b = next;
+    base = start_str;
+    played = moves;
+    return true;
+}
+
+// Splits what is left on the clock into the soft and hard budget of one
+// move. Without movestogo the game is taken to last MOVES_TO_GO more moves;
+// the hard budget stays within HARD_MAX_PCT of the clock unless this is the
+// last move before the time control.
+void allocate_time(int time_left, int inc, int movestogo, int& soft, int& hard) {
+    int avail = std::max(1, time_left - MOVE_OVERHEAD_MS);
+    int mtg = movestogo > 0 ? std::min(movestogo, MOVES_TO_GO) : MOVES_TO_GO;
+    soft = avail / mtg + inc * 3 / 4;
+    hard = std::min(soft * HARD_TIME_FACTOR, mtg > 1 ? avail * HARD_MAX_PCT / 100 : avail);
+    hard = std::max(1, hard);
+    soft = std::max(1, std::min(soft, hard));
 }
 
 void UCIWSServer::on_go(std::vector<std::string>& toks) {
     std::cout << "In method on_go\n";
-    // launch a thread to find the best move
+    bool pondering = std::find(toks.begin(), toks.end(), "ponder") != toks.end();
+
+    if (!position_ok) {
+        std::cout << "No valid position to search\n";
+        if (!requester.expired()) server.sendMessage(requester, "info string error no valid position, send position first");
+        return;
+    }
+
+    // go [ponder] [infinite] [wtime t] [btime t] [winc t] [binc t] [movestogo n] [movetime t]
+    int wtime = -1, btime = -1, winc = 0, binc = 0, movestogo = 0, movetime = 0;
+    for (size_t i = 1; i + 1 < toks.size(); i++) {
+        int *val = toks[i] == "wtime" ? &wtime : toks[i] == "btime" ? &btime
+            : toks[i] == "winc" ? &winc : toks[i] == "binc" ? &binc
+            : toks[i] == "movestogo" ? &movestogo : toks[i] == "movetime" ? &movetime : nullptr;
+        if (!val) continue;
+        try {
+            *val = std::stoi(toks[++i]);
+        }
+        catch (const std::exception& ex) {
+            std::cout << "Bad value for " << toks[i - 1] << "\n";
+        }
+    }
+
+    // b is the position searched, or about to be after a ponder hit
+    int time_left = b.data.player_to_play == WHITE ? wtime : btime;
+    int inc = b.data.player_to_play == WHITE ? winc : binc;
+    int soft = 0, hard = 0;
+    if (movetime > 0) {
+        hard = std::max(1, movetime - MOVE_OVERHEAD_MS);
+    }
+    else if (time_left >= 0) {
+        allocate_time(time_left, inc, movestogo, soft, hard);
+    }
+    e.movetime_ms = hard;
+    e.soft_time_ms = soft;
+
+    // after a ponder hit the search on this position is already running;
+    // any other running search is for an old position
+    if (this->game_thread.joinable() && e.pondering && !ponder_reply) {
+        infinite = std::find(toks.begin(), toks.end(), "infinite") != toks.end();
+        if (!pondering) on_ponderhit();
+        return;
+    }
+    stop_search();
+    infinite = std::find(toks.begin(), toks.end(), "infinite") != toks.end();
+    start_search(b, pondering);
+}
+
+void UCIWSServer::on_ponderhit() {
+    std::cout << "In method on_ponderhit\n";
+    e.pondering = false;
+    if (search_done && !infinite) finish_search();
+}
+
+// launch a thread to find the best move, on its own copy of the position
+void UCIWSServer::start_search(const Board& pos, bool pondering) {
     e.search = true;
-    this->game_thread = std::thread([this]() {
-        e.find_best_move(b);
+    e.pondering = pondering;
+    search_done = false;
+    stop_requested = false;
+    uint64_t id = ++search_id;
+    this->game_thread = std::thread([this, pos, id]() {
+        e.find_best_move(pos);
+        main_evt_loop.post([this, id]() {
+            on_search_done(id);
+        });
     });
 }
 
+// abandons the running search, if any, without answering
+void UCIWSServer::stop_search() {
+    e.search = false;
+    if (this->game_thread.joinable()) this->game_thread.join();
+    e.pondering = false;
+    ponder_reply = 0;
+    search_done = false;
+    stop_requested = false;
+    pending_info.clear();
+    info_timer.cancel();
+}
+
+void UCIWSServer::on_search_done(uint64_t id) {
+    // a search abandoned by stop_search, or one already answered
+    if (id != search_id || !this->game_thread.joinable()) return;
+
+    search_done = true;
+    if (stop_requested || (!e.pondering && !infinite)) finish_search();
+}
+
 void UCIWSServer::on_stop() {
     std::cout << "In method on_stop\n";
+    if (!this->game_thread.joinable()) {
+        std::cout << "No search to stop\n";
+        return;
+    }
+    // bestmove follows from on_search_done once the search unwinds
+    stop_requested = true;
     e.search = false;
+    if (search_done) finish_search();
+}
+
+// Called on the search thread after each iteration. search_id only changes
+// while no search thread runs, so reading it here is safe.
+void UCIWSServer::on_info(const SearchInfo& info) {
+    std::ostringstream line;
+    line << "info depth " << info.depth << " seldepth " << info.seldepth;
+    if (info.mate) line << " score mate " << info.mate;
+    else line << " score cp " << info.score;
+    line << " nodes " << info.nodes << " nps " << info.nodes * 1000 / std::max(1, info.time_ms)
+         << " tbhits " << info.tbhits << " time " << info.time_ms << " pv";
+    for (U16 m : info.pv) line << " " << move_to_str(m);
+
+    uint64_t id = search_id;
+    std::string s = line.str();
+    main_evt_loop.post([this, id, s]() {
+        send_info(id, s);
+    });
+}
+
+void UCIWSServer::send_info(uint64_t id, const std::string& line) {
+    // a search abandoned by stop_search, or one already answered
+    if (id != search_id || !this->game_thread.joinable()) return;
+
+    pending_info = line;
+    auto due = last_info + std::chrono::milliseconds(INFO_INTERVAL_MS);
+    if (std::chrono::steady_clock::now() >= due) {
+        flush_info();
+        return;
+    }
+    // rearming cancels the wait for a line this one replaces
+    info_timer.expires_at(due);
+    info_timer.async_wait([this, id](const asio::error_code& ec) {
+        if (ec || id != search_id || !this->game_thread.joinable()) return;
+        flush_info();
+    });
+}
+
+// sends the held back info line, if any
+void UCIWSServer::flush_info() {
+    info_timer.cancel();
+    if (pending_info.empty()) return;
+    last_info = std::chrono::steady_clock::now();
+    if (!requester.expired()) server.sendMessage(requester, pending_info);
+    pending_info.clear();
+}
+
+// answers with the move of a search that has returned
+void UCIWSServer::finish_search() {
     this->game_thread.join();
+    flush_info();
+    search_done = false;
+    stop_requested = false;
     U16 move = e.best_move;
 
-    // move checking
-    auto legal_moves = b.get_legal_moves();
+    // stopped while pondering before any ponderhit: answer, but the position
+    // searched isn't the one on the board, so nothing is played
+    if (e.pondering) {
+        e.pondering = false;
+        ponder_reply = 0;
+        server.broadcastMessage("bestmove " + move_to_str(move));
+        return;
+    }
 
-    assert(legal_moves.size() > 0);
-    assert(legal_moves.count(move) > 0);
+    // move checking
+    assert(b.get_legal_moves().contains(move));
     b.do_move(move);
+    played.push_back(move);
 
-    auto str_move = move_to_str(move);
-    auto opp_moves = b.get_legal_moves();
-    if (b.in_check()) { // opponent is in check because of our move
-        if (opp_moves.size() > 0) {
-            // check
-            str_move += '+';
-        }
-        else {
-            // checkmate
-            str_move += '#';
-        }
+    // search the reply we expect while the opponent thinks
+    U16 reply = e.ponder_move;
+    if (ponder && reply && b.get_legal_moves().contains(reply)) {
+        server.broadcastMessage("bestmove " + move_to_str(move) + " ponder " + move_to_str(reply));
+        Board next = b;
+        next.do_move(reply);
+        start_search(next, true);
+        ponder_reply = reply;
     }
-    else if (opp_moves.size() == 0) {
-        // stalemate
-        str_move += '-';
+    else {
+        server.broadcastMessage("bestmove " + move_to_str(move));
     }
-
-    server.broadcastMessage("bestmove " + move_to_str(move));
 }
 
 void UCIWSServer::on_quit() {
@@ -1,15 +1,29 @@
 #pragma once
 
+#include <chrono>
 #include <csignal>
 #include <string>
 #include <thread>
 #include <asio/io_service.hpp>
+#include <asio/steady_timer.hpp>
 
 #include "server.hpp"
 #include "board.hpp"
 #include "engine.hpp"
 
-class UCIWSServer {
+// least time between two info lines. A line that comes sooner is held back
+// until the interval is up, replacing any line held before it.
+#define INFO_INTERVAL_MS 100
+
+// Time management: the margin kept for the message round trip, the moves
+// the rest of the game is assumed to last without movestogo, how far the
+// hard budget may go past the soft one and its cap as a share of the clock
+#define MOVE_OVERHEAD_MS 50
+#define MOVES_TO_GO 30
+#define HARD_TIME_FACTOR 4
+#define HARD_MAX_PCT 50
+
+class UCIWSServer : public SearchListener {
 
     public:
 
@@ -26,6 +40,35 @@ class UCIWSServer {
     Board b;
     Engine e;
 
+    // the game as last described by position: the position it started from
+    // and the moves played since, which b is the result of
+    std::string base;
+    std::vector<U16> played;
+    // false after a position that couldn't be set up; b is then stale and
+    // go refuses to search until the next good one
+    bool position_ok = true;
+
+    // Ponder option: keep searching on the opponent's time after bestmove
+    bool ponder = false;
+    // the opponent's reply a search started after our bestmove assumes,
+    // not yet on b. 0 when there is no such search.
+    U16 ponder_reply = 0;
+
+    // The running search. Its thread posts on_search_done to main_evt_loop
+    // when find_best_move returns, tagged with the search_id it was started
+    // under; bestmove goes out from there or from whichever of stop and
+    // ponderhit comes after it.
+    uint64_t search_id = 0;
+    bool search_done = false;     // returned, bestmove not sent yet
+    bool stop_requested = false;
+    bool infinite = false;        // go infinite: no bestmove before stop
+
+    // info lines of the running search go to the client that sent go
+    ClientConnection requester;
+    std::chrono::steady_clock::time_point last_info;
+    std::string pending_info;
+    asio::steady_timer info_timer{main_evt_loop};   // sends pending_info
+
     UCIWSServer(std::string name, uint32_t port);
 
     void start();
@@ -36,8 +79,20 @@ class UCIWSServer {
     void on_uci();
     void on_isready();
     void on_ucinewgame();
+    void on_setoption(std::vector<std::string>& toks);
     void on_position(std::vector<std::string>& toks);
     void on_go(std::vector<std::string>& toks);
     void on_stop();
+    void on_ponderhit();
     void on_quit();
+
+    bool sync(const Board& start, const std::vector<U16>& moves);
+    void start_search(const Board& pos, bool pondering);
+    void stop_search();
+    void on_search_done(uint64_t id);
+    void finish_search();
+
+    void on_info(const SearchInfo& info) override;
+    void send_info(uint64_t id, const std::string& line);
+    void flush_info();
 };
@@ -0,0 +1,53 @@
+# Checks of the board module's batch API. Build the module first, then run
+# from the repository root:
+#   pip install -e . && python -m unittest discover tests
+import unittest
+
+import numpy as np
+
+import board
+
+
+def start_rows(n):
+    return np.stack([board.Board().data for _ in range(n)])
+
+
+class TestLegalMovesBatch(unittest.TestCase):
+
+    def test_matches_single_positions(self):
+        b = board.Board()
+        boards = [b.copy()]
+        for _ in range(6):
+            b.do_move(int(b.get_legal_moves_array()[0]))
+            boards.append(b.copy())
+
+        moves, offsets = board.get_legal_moves_batch(np.stack([x.data for x in boards]), threads=2)
+        for i, x in enumerate(boards):
+            self.assertEqual(list(moves[offsets[i]:offsets[i + 1]]), list(x.get_legal_moves_array()))
+
+    def test_rejects_slot_off_the_board(self):
+        rows = start_rows(3)
+        rows[2, 0] = 200
+        with self.assertRaisesRegex(ValueError, "row 2"):
+            board.get_legal_moves_batch(rows)
+
+    def test_rejects_board_0_disagreeing_with_slots(self):
+        rows = start_rows(2)
+        rows[1, 12 + int(rows[1, 0])] = 0
+        with self.assertRaisesRegex(ValueError, "row 1"):
+            board.get_legal_moves_batch(rows)
+
+    def test_rejects_dead_king(self):
+        rows = start_rows(1)
+        rows[0, 2] = board.DEAD
+        with self.assertRaisesRegex(ValueError, "row 0"):
+            board.get_legal_moves_batch(rows)
+
+    def test_rejects_uninitialised_rows(self):
+        rows = np.full((2, board.BOARD_DATA_SIZE), 0xff, dtype=np.uint8)
+        with self.assertRaisesRegex(ValueError, "row 0"):
+            board.get_legal_moves_batch(rows)
+
+
+if __name__ == "__main__":
+    unittest.main()